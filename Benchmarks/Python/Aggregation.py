@@ -25,11 +25,15 @@ def remove_shm_from_resource_tracker():
         del resource_tracker._CLEANUP_FUNCS["shared_memory"]
 
 import timeit
+import os
+import mmap
 
 import requests
 
 import struct
 import ctypes
+import itertools
+import re
 
 from enum import Enum
  
@@ -49,6 +53,34 @@ class Symbol:
     def __repr__(self):
         return self.__str__()
 
+FORMAT_WORD_TAG = 0x1 # set in the third header word from version 2
+FORMAT_VERSION_2 = 2 # 1-byte argument types (4-byte RLE lengths)
+FORMAT_FLAG_COMPACT_OFFSETS = 0x1 # 32-bit expression offsets
+FORMAT_FLAG_NULL_BITMAP = 0x2 # set bit for each missing/null argument
+
+class ArgTypes:
+    def __init__(self, buffer, typeSize, nulls):
+        self.buffer = buffer
+        self.typeSize = typeSize
+        self.nulls = nulls
+    def type(self, offset):
+        if(self.typeSize == 1):
+            return self.buffer[offset]
+        return struct.unpack("@Q", self.buffer[offset*8:(offset+1)*8])[0]
+    def rleLength(self, offset):
+        start = (offset+1)*self.typeSize
+        return struct.unpack("@I", self.buffer[start:start+4])[0]
+    def isNull(self, offset):
+        return self.nulls is not None and (self.nulls[offset // 8] >> (offset % 8)) & 1 == 1
+
+class Exprs:
+    def __init__(self, buffer, compact):
+        self.buffer = buffer
+        self.format = "@III" if compact else "@QQQ"
+        self.size = struct.calcsize(self.format)
+    def get(self, index):
+        return struct.unpack(self.format, self.buffer[index*self.size:(index+1)*self.size])
+
 class LazyExpression:
     def __init__(self, offset, args, argTypes, exprs, strings):
         self.__args = args
@@ -76,6 +108,7 @@ class LazyExpression:
                 startChild += argCount
             else:
                 yield self.__readArgWithType(startChild, argType)
+                startChild += 1
                 
     def getTypedArguments(self, expectedType):
         head, startChild, endChild = self.__readExpression()
@@ -83,8 +116,8 @@ class LazyExpression:
             argType = self.__readArgumentType(startChild)
             if(argType & 0x80):
                 argType &= ~0x80
+                argCount = self.__readRLELength(startChild)
                 if expectedType == ArgType(argType):
-                    argCount = self.__readRLELength(startChild)
                     for i in range(startChild, startChild + argCount):
                         yield self.__readArgWithType(i, argType)
                 startChild += argCount
@@ -107,18 +140,20 @@ class LazyExpression:
         return struct.unpack("@Q", self.__args[offset*8:(offset+1)*8])[0]
         
     def __readArgumentType(self, offset):
-        return struct.unpack("@Q", self.__argTypes[offset*8:(offset+1)*8])[0]
+        return self.__argTypes.type(offset)
         
     def __readRLELength(self, offset):
-        return struct.unpack("@I", self.__argTypes[(offset+1)*8:(offset+2)*8-4])[0]
+        return self.__argTypes.rleLength(offset)
         
     def __readExpression(self):
-        return struct.unpack("@QQQ", self.__exprs[self.index*24:(self.index+1)*24])
+        return self.__exprs.get(self.index)
         
     def __readArgWithType(self, offset, argType):
+        if(self.__argTypes.isNull(offset)):
+            return None
         match ArgType(argType):
             case ArgType.BOOL:
-                return struct.unpack("@?", self.__args[(offset+1)*8-1:(offset+1)*8])[0]
+                return struct.unpack("@?", self.__args[offset*8:offset*8+1])[0]
             case ArgType.LONG:
                 return struct.unpack("@Q", self.__args[offset*8:(offset+1)*8])[0]
             case ArgType.DOUBLE:
@@ -146,54 +181,223 @@ class LazyExpression:
         str = self.__readString(offset)
         return Symbol(str)
         
-def getRoot(buffer):
+def getRoot(buffer, generation=0):
     argCount, exprCount = struct.unpack("@QQ", buffer[:16])
-    offset = 32 # skip originalAddress, stringArgumentsFillIndex
+    formatWord = struct.unpack("@Q", buffer[16:24])[0]
+    formatVersion, formatFlags = 1, 0 # version 1 stores the original address instead
+    if(formatWord & FORMAT_WORD_TAG):
+        formatVersion, formatFlags = (formatWord & 0xffffffff) >> 1, formatWord >> 32
+    offset = 32 # skip originalAddress/formatWord and stringArgumentsFillIndex
     argsBufferSize = argCount*8
     args = buffer[offset:offset+argsBufferSize]
     offset += argsBufferSize
-    argTypesBufferSize = argCount*8
-    argTypes = buffer[offset:offset+argTypesBufferSize]
+    typeSize = 1 if formatVersion >= FORMAT_VERSION_2 else 8
+    argTypesBufferSize = (argCount*typeSize + 7) & ~7
+    argTypesBuffer = buffer[offset:offset+argTypesBufferSize]
     offset += argTypesBufferSize
-    exprsBufferSize = exprCount*24
-    exprs = buffer[offset:offset+exprsBufferSize]
-    offset += exprsBufferSize
+    nulls = None
+    if(formatFlags & FORMAT_FLAG_NULL_BITMAP):
+        nullBitmapSize = (argCount + 63) // 64 * 8
+        nulls = buffer[offset:offset+nullBitmapSize]
+        offset += nullBitmapSize
+    argTypes = ArgTypes(argTypesBuffer, typeSize, nulls)
+    exprs = Exprs(buffer[offset:], formatFlags & FORMAT_FLAG_COMPACT_OFFSETS)
+    offset += exprCount*exprs.size
     strings = buffer[offset:]
-    return LazyExpression(0, args, argTypes, exprs, strings)
+    root = LazyExpression(0, args, argTypes, exprs, strings)
+    root.segment = (id(buffer), generation) # the dataset's catalog generation, for CompiledPath
+    return root
     
+class CompiledPath:
+    """A path parsed once (same syntax as Source/WisentPath.hpp: name, .name, ["name"], [n], [*]),
+    its resolution cached for the last resolved buffer and generation"""
+    STEP = re.compile(r'\.([^.\[\]]+)|\[(\d+)\]|\[(\*)\]|\[(["\'])(.*?)\4\]')
+    def __init__(self, path):
+        self.steps = []
+        pos = 0
+        if(path and path[0] not in ".["):
+            path = "." + path
+        while(pos < len(path)):
+            match = CompiledPath.STEP.match(path, pos)
+            assert match, "invalid path '" + path + "' at " + str(pos)
+            name, index, wildcard, quote, quotedName = match.groups()
+            if(index is not None):
+                self.steps.append(("index", int(index)))
+            elif(wildcard is not None):
+                self.steps.append(("wildcard", None))
+            else:
+                self.steps.append(("key", name if name is not None else quotedName))
+            pos = match.end()
+        self.cachedSegment = None
+        self.cachedValues = None
+
+    def resolve(self, root):
+        if(root.segment != self.cachedSegment):
+            values = [root]
+            for kind, value in self.steps:
+                values = [child for expr in values if isinstance(expr, LazyExpression)
+                          for child in CompiledPath.__step(expr, kind, value)]
+            self.cachedSegment = root.segment
+            self.cachedValues = values
+        return self.cachedValues
+
+    def clear(self):
+        """drop the cached values (their views prevent closing the segment's buffer)"""
+        self.cachedSegment = None
+        self.cachedValues = None
+
+    @staticmethod
+    def __step(expr, kind, value):
+        if(kind == "key"):
+            return itertools.islice((child for child in expr.getTypedArguments(ArgType.EXPRESSION)
+                                     if child.getHead() == value), 1)
+        if(kind == "index"):
+            return itertools.islice(expr.getArguments(), value, value + 1)
+        return expr.getArguments()
+
+tablePath = CompiledPath("resources[0].Object.path.Table")
+
 def getTable(root):
-    return root.getMapLazyValue("resources").at(0).getMapLazyValue("Object").getMapLazyValue("path").getMapLazyValue("Table")
+    return tablePath.resolve(root)[0]
                
 def getColumn(table, columnName):
     return table.getMapLazyValue(columnName)
     
-def aggregate(buffer, columnName):
-    root = getRoot(buffer)
+def aggregate(buffer, columnName, generation=0):
+    root = getRoot(buffer, generation)
     table = getTable(root)
     aggColumn = getColumn(table, columnName)
     agg = 0.0
     for val in aggColumn.getTypedArguments(ArgType.DOUBLE):
-        agg += val
+        if val is not None:
+            agg += val
     return agg
 
+class FileSegment:
+    """A segment serialized by a server started with --segment-dir (mapped from its file)"""
+    def __init__(self, directory, name):
+        with open(os.path.join(directory, name + ".wisent"), "r+b") as file:
+            self.mapping = mmap.mmap(file.fileno(), 0)
+        self.buf = memoryview(self.mapping)
+
+    def close(self):
+        self.buf.release()
+        self.mapping.close()
+
+def openSegment(name):
+    segmentDir = os.environ.get("WISENT_SEGMENT_DIR")
+    if segmentDir:
+        return FileSegment(segmentDir, name)
+    remove_shm_from_resource_tracker()
+    return shared_memory.SharedMemory(name)
+
+CATALOG_SEGMENT = "wisent_catalog" # published by the server (see WisentCatalog in WisentHelpers.h)
+CATALOG_ENTRY = struct.Struct("<48sIIII48sQQqQIIIIQQQQ")
+CATALOG_FIELDS = ("name", "state", "generation", "sequence", "reserved", "segmentName", "offset",
+                  "size", "loadedAt", "loadNanoseconds", "kind", "formatVersion", "formatFlags",
+                  "tableCount", "columnCount", "rowCount", "argumentCount", "expressionCount")
+DATASET_READY = 2
+DATASET_FAILED = 3
+FUTEX_WAIT = 0
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98}[os.uname().machine]
+libc = ctypes.CDLL(None, use_errno=True)
+
+def futexWait(buf, offset, expected):
+    """Sleep while the 32-bit word at offset is expected (or until a wake-up)"""
+    word = ctypes.c_uint32.from_buffer(buf, offset)
+    try:
+        libc.syscall(SYS_FUTEX, ctypes.byref(word), FUTEX_WAIT, ctypes.c_uint32(expected),
+                     None, None, 0)
+    finally:
+        del word # (releases the buffer)
+
+def catalogEntryOffsets(buf):
+    count = struct.unpack_from("<I", buf, 8)[0]
+    return count, [16 + i * CATALOG_ENTRY.size for i in range(count)]
+
+def readCatalogEntry(buf, offset):
+    """A consistent snapshot of the entry (copied again while the server updates it)"""
+    while True:
+        sequence = struct.unpack_from("<I", buf, offset + 56)[0]
+        if sequence & 1:
+            continue
+        values = CATALOG_ENTRY.unpack_from(buf, offset)
+        if struct.unpack_from("<I", buf, offset + 56)[0] == sequence:
+            break
+    entry = dict(zip(CATALOG_FIELDS, values))
+    entry["name"] = entry["name"].rstrip(b"\0").decode()
+    entry["segmentName"] = entry["segmentName"].rstrip(b"\0").decode()
+    return entry
+
+def listDatasets():
+    """The entries of the server's catalog (name, state, segmentName, offset, size, ...)"""
+    catalog = openSegment(CATALOG_SEGMENT)
+    try:
+        return [readCatalogEntry(catalog.buf, offset)
+                for offset in catalogEntryOffsets(catalog.buf)[1]]
+    finally:
+        catalog.close()
+
+class Dataset:
+    """A loaded dataset, mapped from the segment listed in the catalog (buf: its tree)"""
+    def __init__(self, entry):
+        self.entry = entry
+        self.segment = openSegment(entry["segmentName"])
+        self.buf = self.segment.buf[entry["offset"]:entry["offset"] + entry["size"]]
+
+    def close(self):
+        self.buf.release()
+        self.segment.close()
+
+def attachDataset(name):
+    """Map a loaded dataset, found in the catalog (no request to the server)"""
+    entry = next((entry for entry in listDatasets()
+                  if entry["name"] == name and entry["state"] == DATASET_READY), None)
+    if entry is None:
+        raise KeyError("no dataset '" + name + "' in the server's catalog")
+    return Dataset(entry)
+
+def waitForDataset(name):
+    """Sleep until the server loaded (True) or failed to load (False) the dataset"""
+    catalog = openSegment(CATALOG_SEGMENT)
+    try:
+        while True:
+            count, offsets = catalogEntryOffsets(catalog.buf)
+            offset = next((offset for offset in offsets
+                           if struct.unpack_from("48s", catalog.buf, offset)[0].rstrip(b"\0")
+                           == name.encode()), None)
+            if offset is None:
+                futexWait(catalog.buf, 8, count) # not requested yet: wait for a new entry
+                continue
+            state = struct.unpack_from("<I", catalog.buf, offset + 48)[0]
+            if state in (DATASET_READY, DATASET_FAILED):
+                return state == DATASET_READY
+            futexWait(catalog.buf, offset + 48, state)
+    finally:
+        catalog.close()
+
 def main():
     # request server to load data
     URL="http://localhost:3000"
     datapackageName = "datapackage" + datasetSuffix + ".json"
     #resp = requests.get(url=URL+'/load', params={'name':'datapackage', 'path':'../Data/owid-deaths/' + datapackageName})
-    resp = requests.get(url=URL+'/load', params={'name':'datapackage', 'path':'../Data/opsd-weather/' + datapackageName})
-    print("loading response: " + (resp.text if resp.ok else str(resp.headers)))
+    resp = requests.get(url=URL+'/load', params={'name':'datapackage', 'path':'../Data/opsd-weather/' + datapackageName, 'async':'1'})
+    print("loading job: " + (resp.text if resp.ok else str(resp.headers)))
+    if not resp.ok or not waitForDataset("datapackage"):
+        print("loading failed: " + requests.get(url=URL+'/jobs/'+resp.text).text)
+        return
     
     #columnName = "Accidents (excl. road) - Death Rates"
     columnName = "GB_temperature"
         
     # deserialize and perform the aggregation
-    remove_shm_from_resource_tracker()
-    datapackage = shared_memory.SharedMemory("datapackage")
+    datapackage = attachDataset("datapackage")
+    generation = datapackage.entry["generation"]
     try:
-        print("runtime: {} s".format(timeit.Timer(lambda: aggregate(datapackage.buf, columnName)).timeit(1)))
-        print("agg={}".format(aggregate(datapackage.buf, columnName)))
+        print("runtime: {} s".format(timeit.Timer(lambda: aggregate(datapackage.buf, columnName, generation)).timeit(1)))
+        print("agg={}".format(aggregate(datapackage.buf, columnName, generation)))
     finally:
+        tablePath.clear()
         datapackage.close()
         # request server to unload the data
         resp = requests.get(url=URL+'/unload', params={'name':'datapackage'})
@@ -39,6 +39,34 @@ class ArgType(Enum):
     SYMBOL = 4
     EXPRESSION = 5
     
+FORMAT_WORD_TAG = 0x1 # set in the third header word from version 2
+FORMAT_VERSION_2 = 2 # 1-byte argument types (4-byte RLE lengths)
+FORMAT_FLAG_COMPACT_OFFSETS = 0x1 # 32-bit expression offsets
+FORMAT_FLAG_NULL_BITMAP = 0x2 # set bit for each missing/null argument
+
+class ArgTypes:
+    def __init__(self, buffer, typeSize, nulls):
+        self.buffer = buffer
+        self.typeSize = typeSize
+        self.nulls = nulls
+    def type(self, offset):
+        if(self.typeSize == 1):
+            return self.buffer[offset]
+        return struct.unpack("@Q", self.buffer[offset*8:(offset+1)*8])[0]
+    def rleLength(self, offset):
+        start = (offset+1)*self.typeSize
+        return struct.unpack("@I", self.buffer[start:start+4])[0]
+    def isNull(self, offset):
+        return self.nulls is not None and (self.nulls[offset // 8] >> (offset % 8)) & 1 == 1
+
+class Exprs:
+    def __init__(self, buffer, compact):
+        self.buffer = buffer
+        self.format = "@III" if compact else "@QQQ"
+        self.size = struct.calcsize(self.format)
+    def get(self, index):
+        return struct.unpack(self.format, self.buffer[index*self.size:(index+1)*self.size])
+
 class Expression:
     def __init__(self, head):
         self.head = head
@@ -69,7 +97,7 @@ def argsToTable(table):
     return dict
     
 def readExpression(offset, args, argTypes, exprs, strings):
-    head, startChild, endChild = struct.unpack("@QQQ", exprs[offset*24:(offset+1)*24])
+    head, startChild, endChild = exprs.get(offset)
     headStr = readSymbol(head, strings).name
     expr = Expression(headStr)
     readArgs(expr.args, startChild, endChild, args, argTypes, exprs, strings)
@@ -84,10 +112,10 @@ def readExpression(offset, args, argTypes, exprs, strings):
 
 def readArgs(outputArgs, startChild, endChild, args, argTypes, exprs, strings):
     while(startChild < endChild):
-        argType = struct.unpack("@Q", argTypes[startChild*8:(startChild+1)*8])[0]
+        argType = argTypes.type(startChild)
         if(argType & 0x80):
             argType &= ~0x80
-            argCount = struct.unpack("@I", argTypes[(startChild+1)*8:(startChild+2)*8-4])[0]
+            argCount = argTypes.rleLength(startChild)
             #print("unpacking RLE - argType:" + str(argType) + " argCount:" + str(argCount))
             for i in range(startChild, startChild + argCount):
                 outputArgs.append(readArgWithType(argType, i, args, argTypes, exprs, strings))
@@ -111,13 +139,15 @@ def readSymbol(offset, strings):
     return Symbol(str)
     
 def readArg(offset, args, argTypes, exprs, strings):
-    argType = struct.unpack("@Q", argTypes[offset*8:(offset+1)*8])[0]
+    argType = argTypes.type(offset)
     return readArgWithType(argType, offset, args, argTypes, exprs, strings)
 
 def readArgWithType(argType, offset, args, argTypes, exprs, strings):
+    if(argTypes.isNull(offset)):
+        return None
     match ArgType(argType):
         case ArgType.BOOL:
-            return struct.unpack("@?", args[(offset+1)*8-1:(offset+1)*8])[0]
+            return struct.unpack("@?", args[offset*8:offset*8+1])[0]
         case ArgType.LONG:
             return struct.unpack("@Q", args[offset*8:(offset+1)*8])[0]
         case ArgType.DOUBLE:
@@ -134,16 +164,26 @@ def readArgWithType(argType, offset, args, argTypes, exprs, strings):
 
 def deserialize(buffer):
     argCount, exprCount = struct.unpack("@QQ", buffer[:16])
-    offset = 32 # skip originalAddress, stringArgumentsFillIndex
+    formatWord = struct.unpack("@Q", buffer[16:24])[0]
+    formatVersion, formatFlags = 1, 0 # version 1 stores the original address instead
+    if(formatWord & FORMAT_WORD_TAG):
+        formatVersion, formatFlags = (formatWord & 0xffffffff) >> 1, formatWord >> 32
+    offset = 32 # skip originalAddress/formatWord and stringArgumentsFillIndex
     argsBufferSize = argCount*8
     args = buffer[offset:offset+argsBufferSize]
     offset += argsBufferSize
-    argTypesBufferSize = argCount*8
-    argTypes = buffer[offset:offset+argTypesBufferSize]
+    typeSize = 1 if formatVersion >= FORMAT_VERSION_2 else 8
+    argTypesBufferSize = (argCount*typeSize + 7) & ~7
+    argTypesBuffer = buffer[offset:offset+argTypesBufferSize]
     offset += argTypesBufferSize
-    exprsBufferSize = exprCount*24
-    exprs = buffer[offset:offset+exprsBufferSize]
-    offset += exprsBufferSize
+    nulls = None
+    if(formatFlags & FORMAT_FLAG_NULL_BITMAP):
+        nullBitmapSize = (argCount + 63) // 64 * 8
+        nulls = buffer[offset:offset+nullBitmapSize]
+        offset += nullBitmapSize
+    argTypes = ArgTypes(argTypesBuffer, typeSize, nulls)
+    exprs = Exprs(buffer[offset:], formatFlags & FORMAT_FLAG_COMPACT_OFFSETS)
+    offset += exprCount*exprs.size
     strings = buffer[offset:]
     return readArg(0, args, argTypes, exprs, strings)
 
@@ -1,9 +1,15 @@
+#include "../Source/ControlChannel.hpp"
 #include "../Source/CsvLoading.hpp"
 #include "../Source/SharedMemorySegment.hpp"
+#include "../Source/WisentAccessHints.h"
+#include "../Source/WisentCatalog.h"
 #include "../Source/WisentHelpers.h"
+#include "../Source/WisentPath.hpp"
+#include "../Source/WisentSerializer.hpp"
 #include "ITTNotifySupport.hpp"
 #include <benchmark/benchmark.h>
 #include <cpp-httplib/httplib.h>
+#include <fstream>
 #include <map>
 #include <nlohmann/json.hpp>
 #include <rapidjson/document.h>
@@ -11,6 +17,9 @@
 #include <simdjson/error.h>
 #include <simdjson/implementation.h>
 #include <simdjson/padded_string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <thread>
 
 using json = nlohmann::json;
 
@@ -51,6 +60,54 @@ static std::map<std::string, std::string> predicateColumnMap = {{"owid-deaths",
 static std::map<std::string, std::string> aggregateColumnMap = {
     {"owid-deaths", "Accidents (excl. road) - Death Rates"}, {"opsd-weather", "GB_temperature"}};
 
+/* the server's catalog segment, listing its datasets */
+static WisentCatalog* catalog() {
+  static auto* catalog = []() {
+    auto& segment = createOrGetMemorySegment(WISENT_CATALOG_SEGMENT);
+    segment.load();
+    if(!segment.loaded()) {
+      throw std::runtime_error("cannot open the server's '" WISENT_CATALOG_SEGMENT "'");
+    }
+    return static_cast<WisentCatalog*>(segment.baseAddress());
+  }();
+  return catalog;
+}
+
+/* the dataset's entry in the catalog (where it is) */
+static WisentCatalogEntry findDataset(std::string const& name) {
+  WisentCatalogEntry entry{};
+  if(!readCatalogEntry(catalog(), name.c_str(), &entry) ||
+     entry.state != WISENT_DATASET_READY) {
+    throw std::runtime_error("no dataset '" + name + "' in the server's catalog");
+  }
+  return entry;
+}
+
+static std::string CONTROL_SOCKET; // the server's --control-socket: requests without HTTP
+
+/* a connection to the server's control socket (per thread) */
+static wisent::control::ControlClient& controlClient() {
+  thread_local wisent::control::ControlClient client(CONTROL_SOCKET);
+  return client;
+}
+
+/* send a batch of commands on the control socket (one round trip), throwing the first failure */
+static std::vector<wisent::control::Reply>
+runCommands(std::vector<wisent::control::Command> const& commands) {
+  auto replies = controlClient().send(commands);
+  for(auto const& reply : replies) {
+    if(reply.status != 0) {
+      for(auto const& other : replies) {
+        if(other.descriptor >= 0) {
+          close(other.descriptor);
+        }
+      }
+      throw std::runtime_error("control command failed: " + reply.error);
+    }
+  }
+  return replies;
+}
+
 class SharedMemoryData {
 public:
   SharedMemoryData(std::string const& name, std::string const& sizeSuffix, bool asJson = false,
@@ -61,34 +118,73 @@ public:
     // request data loading
     auto filepath = "../Data/" + name + "/datapackage" + sizeSuffix + ".json";
     auto& prevFilepath = loadedFiles[sharedMemoryName];
-    httplib::Client client("localhost", 3000);
-    client.set_connection_timeout(3600);
-    client.set_read_timeout(3600);
-    client.set_write_timeout(3600);
-    httplib::Params params = {{"name", sharedMemoryName},
-                              {"path", filepath},
-                              {"toJson", asJson ? "true" : "false"},
-                              {"toBson", asBson ? "true" : "false"},
-                              {"loadCSV", csvLoading ? "true" : "false"}};
-    if(filepath != prevFilepath) {
-      client.Get("/erase", params, httplib::Headers());
-    }
-    client.Get("/load", params, httplib::Headers());
+    if(!CONTROL_SOCKET.empty()) {
+      // (erasing the previous file and loading in a single batch, replied once loaded)
+      std::vector<wisent::control::Command> commands;
+      if(filepath != prevFilepath) {
+        commands.push_back({WISENT_CONTROL_ERASE, 0, sharedMemoryName, {}});
+      }
+      uint32_t flags = (asJson ? WISENT_CONTROL_TO_JSON : 0) |
+                       (asBson ? WISENT_CONTROL_TO_BSON : 0) |
+                       (csvLoading ? 0 : WISENT_CONTROL_SKIP_CSV);
+      commands.push_back({WISENT_CONTROL_LOAD, flags, sharedMemoryName, filepath});
+      runCommands(commands);
+    } else {
+      httplib::Client client("localhost", 3000);
+      httplib::Params params = {{"name", sharedMemoryName},
+                                {"path", filepath},
+                                {"toJson", asJson ? "true" : "false"},
+                                {"toBson", asBson ? "true" : "false"},
+                                {"loadCSV", csvLoading ? "true" : "false"},
+                                {"async", "true"}};
+      if(filepath != prevFilepath) {
+        client.Get("/erase", params, httplib::Headers());
+      }
+      auto response = client.Get("/load", params, httplib::Headers());
+      if(!response || response->status != 200) {
+        throw std::runtime_error("failed to request loading '" + sharedMemoryName + "'");
+      }
+      // sleep until the server publishes the end of the load (instead of a blocking request)
+      if(waitForDataset(catalog(), sharedMemoryName.c_str(), -1) != WISENT_DATASET_READY) {
+        throw std::runtime_error("failed to load '" + sharedMemoryName + "' (see /jobs/" +
+                                 response->body + ")");
+      }
+    }
     prevFilepath = filepath;
-    // open shared memory
-    sharedMemory = &createOrGetMemorySegment(sharedMemoryName);
+    // open shared memory (found in the catalog: its own segment or the server's arena)
+    auto entry = findDataset(sharedMemoryName);
+    segmentName = entry.description.segmentName;
+    sharedMemory = &createOrGetMemorySegment(segmentName);
     sharedMemory->load();
     if(!sharedMemory->loaded()) {
       throw std::runtime_error("cannot load '" + sharedMemoryName + "'");
     }
+    if(segmentName != sharedMemoryName) { // (a tree of the server's arena: held while read)
+      data = acquireArenaEntry(sharedMemory->baseAddress(), sharedMemoryName.c_str(),
+                               &arenaReaderSlot);
+      if(data == nullptr) {
+        throw std::runtime_error("no '" + sharedMemoryName + "' in the arena " + segmentName);
+      }
+      arenaReader = true;
+    } else {
+      data = static_cast<char*>(sharedMemory->baseAddress()) + entry.description.offset;
+    }
+    dataGeneration = entry.generation;
   }
 
   ~SharedMemoryData() {
     if(sharedMemory != nullptr) {
+      if(arenaReader) {
+        releaseArenaEntry(sharedMemory->baseAddress(), arenaReaderSlot);
+      }
       sharedMemory->unload();
       sharedMemory = nullptr;
     }
-    sharedMemorySegments().erase(sharedMemoryName);
+    eraseMemorySegment(segmentName);
+    if(!CONTROL_SOCKET.empty()) {
+      controlClient().send({{WISENT_CONTROL_UNLOAD, 0, sharedMemoryName, {}}});
+      return;
+    }
     httplib::Client client("localhost", 3000);
     httplib::Params params = {{"name", sharedMemoryName}};
     client.Get("/unload", params, httplib::Headers());
@@ -96,17 +192,25 @@ public:
 
   template <typename T> T begin() {
     assert(sharedMemory);
-    return static_cast<T>(sharedMemory->baseAddress());
+    return static_cast<T>(data);
   }
 
   template <typename T> T end() {
     assert(sharedMemory);
-    return begin<T>() + sharedMemory->size();
+    return static_cast<T>(sharedMemory->baseAddress()) + sharedMemory->size();
   }
 
+  /* the dataset's generation in the catalog (to resolve compiled paths) */
+  uint32_t generation() const { return dataGeneration; }
+
 private:
   std::string sharedMemoryName;
+  std::string segmentName; // (the arena's if the dataset is one of its entries)
   SharedMemorySegment* sharedMemory;
+  void* data = nullptr;
+  uint32_t dataGeneration = 0;
+  bool arenaReader = false; // (counted as a reader of its tree, see acquireArenaEntry())
+  uint64_t arenaReaderSlot = 0;
 };
 
 class LazyExpression {
@@ -114,21 +218,26 @@ public:
   LazyExpression(WisentRootExpression* root, uint64_t index) : root(root), index(index) {}
 
   LazyExpression operator[](size_t childOffset) const {
-    auto const& expr = expression();
+    auto expr = expression();
     assert(childOffset < expr.startChildOffset - expr.endChildOffset);
     return {root, expr.startChildOffset + childOffset};
   }
 
   LazyExpression operator[](std::string const& keyName) const {
-    auto const& expr = expression();
+    if(auto const* keyIndex = getKeyIndexEntry(root, expressionIndex())) {
+      auto i = findKeyArgument(root, keyIndex, keyName.data(), keyName.size());
+      if(i == UINT64_MAX) {
+        throw std::runtime_error(keyName + " not found.");
+      }
+      return {root, i};
+    }
+    auto expr = expression();
     auto const& arguments = getExpressionArguments(root);
-    auto const& argumentTypes = getArgumentTypes(root);
-    auto const& expressions = getExpressionSubexpressions(root);
-    for(auto i = expr.startChildOffset; i < expr.endChildOffset; ++i) {
-      if(argumentTypes[i] != WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+    for(auto i = expr.startChildOffset; i < expr.endChildOffset; i = getArgumentRunEnd(root, i)) {
+      if(getArgumentType(root, i) != WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
         continue;
       }
-      auto const& child = expressions[arguments[i].asExpression];
+      auto child = getExpression(root, arguments[i].asExpression);
       auto const& key = viewString(root, child.symbolNameOffset);
       if(std::string_view{key} == keyName) {
         return {root, i};
@@ -140,9 +249,9 @@ public:
   template <typename T> class Iterator : public std::iterator<std::forward_iterator_tag, T> {
   public:
     Iterator(WisentRootExpression* root, uint64_t index)
-        : root(root), arguments(getExpressionArguments(root)),
-          argumentTypes(getArgumentTypes(root)), index(index), validIndexEnd(index) {
-      updateValidIndexEnd();
+        : root(root), arguments(getExpressionArguments(root)), index(index), runEnd(index),
+          runMatchesType(false) {
+      updateRun();
     }
     virtual ~Iterator() = default;
 
@@ -152,7 +261,7 @@ public:
       return *this;
     }
 
-    bool isValid() { return index < validIndexEnd; }
+    bool isValid() { return runMatchesType && !isArgumentNull(root, index); }
 
     T& operator*() const {
       if constexpr(std::is_same_v<T, int64_t>) {
@@ -165,35 +274,41 @@ public:
     }
     T* operator->() const { return &operator*(); }
 
-    Iterator operator+(std::ptrdiff_t v) const { return incrementIndex(v); }
+    Iterator operator+(std::ptrdiff_t v) const {
+      auto it = *this;
+      it.incrementIndex(v);
+      return it;
+    }
     bool operator==(const Iterator& rhs) const { return index == rhs.index; }
     bool operator!=(const Iterator& rhs) const { return index != rhs.index; }
 
   private:
     WisentRootExpression* root;
     WisentArgumentValue* arguments;
-    WisentArgumentType* argumentTypes;
     uint64_t index;
-    uint64_t validIndexEnd;
+    uint64_t runEnd;     // end of the run of arguments (of any type) containing index
+    bool runMatchesType; // whether this run's type is T
 
     uint64_t incrementIndex(std::ptrdiff_t increment) {
-      index += increment;
-      updateValidIndexEnd();
+      // the types inside a run are not readable (e.g. they hold the RLE length): jump run by run
+      auto target = index + increment;
+      while(runEnd < target) {
+        index = runEnd;
+        updateRun();
+      }
+      index = target;
+      updateRun();
       return index;
     }
 
-    void updateValidIndexEnd() {
-      if(index >= validIndexEnd) {
-        if(argumentTypes[index] & WisentArgumentType_RLE_BIT) {
-          if((argumentTypes[index] & ~WisentArgumentType_RLE_BIT) == expectedArgumentType()) {
-            validIndexEnd = index + static_cast<uint32_t>(argumentTypes[index + 1]);
-          }
-        } else {
-          if(argumentTypes[index] == expectedArgumentType()) {
-            validIndexEnd = index + 1;
-          }
-        }
+    void updateRun() {
+      if(index < runEnd) {
+        return;
       }
+      auto argumentType = getArgumentType(root, index);
+      auto isRun = (argumentType & WisentArgumentType_RLE_BIT) != 0;
+      runEnd = index + (isRun ? getRLELength(root, index) : 1);
+      runMatchesType = (argumentType & ~WisentArgumentType_RLE_BIT) == expectedArgumentType();
     }
 
     constexpr WisentArgumentType expectedArgumentType() {
@@ -212,19 +327,40 @@ public:
   }
   template <typename T> Iterator<T> end() { return Iterator<T>(root, expression().endChildOffset); }
 
+  uint64_t expressionIndex() const { return getExpressionArguments(root)[index].asExpression; }
+
 private:
   WisentRootExpression* root;
   uint64_t index;
 
-  WisentExpression const& expression() const {
+  WisentExpression expression() const {
     auto const& arguments = getExpressionArguments(root);
-    auto const& argumentTypes = getArgumentTypes(root);
-    auto const& expressions = getExpressionSubexpressions(root);
-    assert(argumentTypes[index] == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION);
-    return expressions[arguments[index].asExpression];
+    assert(getArgumentType(root, index) == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION);
+    return getExpression(root, arguments[index].asExpression);
   }
 };
 
+/* the query of the scan benchmarks: sum of a column where the predicate column <= predValue */
+static double aggregateWisent(WisentRootExpression* root, std::string const& aggColumnStr,
+                              std::string const& predColumnStr, int64_t predValue) {
+  auto table = LazyExpression(root, 0)["resources"][0]["Object"]["path"]["Table"];
+  auto aggColumn = table[aggColumnStr];
+  auto predColumn = table[predColumnStr];
+  auto predIt = predColumn.begin<int64_t>();
+  auto agg = 0.0;
+  for(auto aggIt = aggColumn.begin<double_t>(); aggIt != aggColumn.end<double_t>();
+      ++aggIt, ++predIt) {
+    if(!aggIt.isValid() || !predIt.isValid()) {
+      continue;
+    }
+    if(*predIt > predValue) {
+      continue;
+    }
+    agg += *aggIt;
+  }
+  return agg;
+}
+
 void runWisent(benchmark::State& state, std::string const& dataset, std::string sizeSuffix,
                int64_t selectivityFraction) {
   auto const& predValue = predicateValues[dataset][selectivityFraction];
@@ -235,9 +371,33 @@ void runWisent(benchmark::State& state, std::string const& dataset, std::string
   vtune.startSampling("Wisent");
   auto agg = 0.0;
   for(auto _ : state) {
-    auto table = LazyExpression(root, 0)["resources"][0]["Object"]["path"]["Table"];
-    auto aggColumn = table[aggColumnStr];
-    auto predColumn = table[predColumnStr];
+    agg = aggregateWisent(root, aggColumnStr, predColumnStr, predValue);
+    assert(agg > 0.0);
+    benchmark::DoNotOptimize(agg);
+  }
+  vtune.stopSampling();
+  if(VERBOSE) {
+    std::cout << "output: agg=" << agg << std::endl;
+  }
+}
+
+/* same query as runWisent, navigating to the columns with compiled paths (resolved once) */
+void runWisentCompiledPath(benchmark::State& state, std::string const& dataset,
+                           std::string sizeSuffix, int64_t selectivityFraction) {
+  auto const& predValue = predicateValues[dataset][selectivityFraction];
+  auto const& predColumnStr = predicateColumnMap[dataset];
+  auto const& aggColumnStr = aggregateColumnMap[dataset];
+  SharedMemoryData data(dataset, sizeSuffix);
+  auto* root = data.begin<WisentRootExpression*>();
+  auto const tablePath = std::string("resources[0].Object.path.Table");
+  auto const aggColumnPath = wisent::path::CompiledPath(tablePath + "[\"" + aggColumnStr + "\"]");
+  auto const predColumnPath =
+      wisent::path::CompiledPath(tablePath + "[\"" + predColumnStr + "\"]");
+  vtune.startSampling("WisentCompiledPath");
+  auto agg = 0.0;
+  for(auto _ : state) {
+    auto aggColumn = LazyExpression(root, aggColumnPath.resolve(root, data.generation()).at(0));
+    auto predColumn = LazyExpression(root, predColumnPath.resolve(root, data.generation()).at(0));
     auto predIt = predColumn.begin<int64_t>();
     agg = 0.0;
     for(auto aggIt = aggColumn.begin<double_t>(); aggIt != aggColumn.end<double_t>();
@@ -259,6 +419,93 @@ void runWisent(benchmark::State& state, std::string const& dataset, std::string
   }
 }
 
+/* same query as runWisent, skipping or summing whole blocks using the zone maps
+ * (the Wisent Server needs to be started with --zone-map-block-size) */
+void runWisentZoneMaps(benchmark::State& state, std::string const& dataset,
+                       std::string sizeSuffix, int64_t selectivityFraction) {
+  auto const& predValue = predicateValues[dataset][selectivityFraction];
+  auto const& predColumnStr = predicateColumnMap[dataset];
+  auto const& aggColumnStr = aggregateColumnMap[dataset];
+  SharedMemoryData data(dataset, sizeSuffix);
+  auto* root = data.begin<WisentRootExpression*>();
+  auto table = LazyExpression(root, 0)["resources"][0]["Object"]["path"]["Table"];
+  auto const* predStats = getColumnStats(root, table[predColumnStr].expressionIndex());
+  auto const* aggStats = getColumnStats(root, table[aggColumnStr].expressionIndex());
+  if(predStats == nullptr || aggStats == nullptr ||
+     predStats->type != static_cast<uint64_t>(WisentArgumentType::ARGUMENT_TYPE_LONG) ||
+     aggStats->type != static_cast<uint64_t>(WisentArgumentType::ARGUMENT_TYPE_DOUBLE)) {
+    state.SkipWithError("no zone maps for the predicate/aggregate columns");
+    return;
+  }
+  auto blockSize = getZoneMaps(root)->blockSize;
+  vtune.startSampling("WisentZoneMaps");
+  auto agg = 0.0;
+  for(auto _ : state) {
+    table = LazyExpression(root, 0)["resources"][0]["Object"]["path"]["Table"];
+    auto aggColumn = table[aggColumnStr];
+    auto predColumn = table[predColumnStr];
+    auto const* predBlocks = getBlockStats(root, predStats);
+    auto const* aggBlocks = getBlockStats(root, aggStats);
+    agg = 0.0;
+    auto predIt = predColumn.begin<int64_t>();
+    auto aggIt = aggColumn.begin<double_t>();
+    for(uint64_t block = 0; block < predStats->blockCount; ++block) {
+      auto const& predBlock = predBlocks[block];
+      auto blockRows = predBlock.count + predBlock.nullCount;
+      if(predBlock.count == 0 || predBlock.min.asLong > predValue) {
+        // no row matches
+      } else if(predBlock.max.asLong <= predValue && predBlock.nullCount == 0) {
+        agg += aggBlocks[block].sum.asDouble; // all the rows match
+      } else {
+        auto blockEnd = aggIt + blockRows;
+        auto rowPredIt = predIt;
+        for(auto rowAggIt = aggIt; rowAggIt != blockEnd; ++rowAggIt, ++rowPredIt) {
+          if(!rowAggIt.isValid() || !rowPredIt.isValid()) {
+            continue;
+          }
+          if(*rowPredIt > predValue) {
+            continue;
+          }
+          agg += *rowAggIt;
+        }
+      }
+      if(block + 1 < predStats->blockCount) {
+        predIt = predIt + blockSize;
+        aggIt = aggIt + blockSize;
+      }
+    }
+    assert(agg > 0.0);
+    benchmark::DoNotOptimize(agg);
+  }
+  vtune.stopSampling();
+  if(VERBOSE) {
+    std::cout << "output: agg=" << agg << std::endl;
+  }
+}
+
+/* look up each column of the table by name
+ * (uses the key index if the Wisent Server is started with --key-index-min-keys) */
+void runWisentKeyLookup(benchmark::State& state, std::string const& dataset,
+                        std::string sizeSuffix) {
+  SharedMemoryData data(dataset, sizeSuffix);
+  auto* root = data.begin<WisentRootExpression*>();
+  auto table = LazyExpression(root, 0)["resources"][0]["Object"]["path"]["Table"];
+  std::vector<std::string> columnNames;
+  auto tableExpression = getExpression(root, table.expressionIndex());
+  for(auto i = tableExpression.startChildOffset; i < tableExpression.endChildOffset; ++i) {
+    auto column = getExpression(root, getExpressionArguments(root)[i].asExpression);
+    columnNames.emplace_back(viewString(root, column.symbolNameOffset));
+  }
+  vtune.startSampling("WisentKeyLookup");
+  for(auto _ : state) {
+    for(auto const& columnName : columnNames) {
+      benchmark::DoNotOptimize(table[columnName]);
+    }
+  }
+  vtune.stopSampling();
+  state.counters["Keys"] = static_cast<double>(columnNames.size());
+}
+
 void runJsonCsv(benchmark::State& state, std::string const& dataset, std::string sizeSuffix,
                 int64_t selectivityFraction) {
   auto predValue = predicateValues[dataset][selectivityFraction];
@@ -453,6 +700,182 @@ void runBson(benchmark::State& state, std::string const& dataset, std::string si
   }
 }
 
+/* reset the process' peak resident set size (Linux only, ignored elsewhere) */
+static void resetPeakMemory() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+/* peak resident set size (VmHWM) in kB since the last reset */
+static int64_t peakMemoryKB() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while(std::getline(status, line)) {
+    if(line.rfind("VmHWM:", 0) == 0) {
+      return std::stol(line.substr(sizeof("VmHWM:")));
+    }
+  }
+  return 0;
+}
+
+void runWisentLoad(benchmark::State& state, std::string const& dataset, std::string sizeSuffix,
+                   wisent::serializer::LoadOptions options) {
+  auto filepath = "../Data/" + dataset + "/datapackage" + sizeSuffix + ".json";
+  auto csvPrefix = "../Data/" + dataset + "/";
+  auto sharedMemoryName = dataset + "_load";
+  options.forceReload = true;
+  resetPeakMemory();
+  vtune.startSampling("WisentLoad");
+  for(auto _ : state) {
+    auto* root = wisent::serializer::load(filepath, sharedMemoryName, csvPrefix, options);
+    benchmark::DoNotOptimize(root);
+  }
+  vtune.stopSampling();
+  state.counters["PeakMemoryKB"] = static_cast<double>(peakMemoryKB());
+  wisent::serializer::free(sharedMemoryName);
+}
+
+/* load state.range(0) copies of the dataset at once, one per thread (as concurrent /load
+ * requests do), each converting its CSV columns sequentially */
+void runWisentConcurrentLoad(benchmark::State& state, std::string const& dataset,
+                             std::string sizeSuffix) {
+  auto filepath = "../Data/" + dataset + "/datapackage" + sizeSuffix + ".json";
+  auto csvPrefix = "../Data/" + dataset + "/";
+  auto threadCount = static_cast<size_t>(state.range(0));
+  wisent::serializer::LoadOptions options;
+  options.forceReload = true;
+  options.csvThreads = 1;
+  for(auto _ : state) {
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < threadCount; ++i) {
+      threads.emplace_back([&, i]() {
+        auto sharedMemoryName = dataset + "_load_" + std::to_string(i);
+        auto* root = wisent::serializer::load(filepath, sharedMemoryName, csvPrefix, options);
+        benchmark::DoNotOptimize(root);
+      });
+    }
+    for(auto& thread : threads) {
+      thread.join();
+    }
+  }
+  state.counters["Datasets"] = benchmark::Counter(static_cast<double>(threadCount),
+                                                 benchmark::Counter::kIsIterationInvariantRate);
+  for(size_t i = 0; i < threadCount; ++i) {
+    wisent::serializer::free(dataset + "_load_" + std::to_string(i));
+  }
+}
+
+/* map an already serialized dataset again, as a restarted server does with its segments */
+void runWisentWarmRestart(benchmark::State& state, std::string const& dataset,
+                          std::string sizeSuffix) {
+  auto filepath = "../Data/" + dataset + "/datapackage" + sizeSuffix + ".json";
+  auto csvPrefix = "../Data/" + dataset + "/";
+  auto sharedMemoryName = dataset + "_restart";
+  wisent::serializer::LoadOptions options;
+  options.forceReload = true;
+  wisent::serializer::load(filepath, sharedMemoryName, csvPrefix, options);
+  options.forceReload = false;
+  for(auto _ : state) {
+    state.PauseTiming();
+    wisent::serializer::unload(sharedMemoryName);
+    eraseMemorySegment(sharedMemoryName); // (as in a new process)
+    state.ResumeTiming();
+    auto* root = wisent::serializer::load(filepath, sharedMemoryName, csvPrefix, options);
+    benchmark::DoNotOptimize(root);
+  }
+  wisent::serializer::free(sharedMemoryName);
+}
+
+/* page faults (minor, major) of the process so far */
+static std::pair<int64_t, int64_t> pageFaults() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return {usage.ru_minflt, usage.ru_majflt};
+}
+
+enum class AttachHint { none, populate, advise };
+
+/* find the dataset in the catalog, map its segment and run the scan query on every iteration,
+ * as a newly attached reader does, reporting the page faults: prefaulting the mapping or
+ * advising the columns' pages */
+void runWisentAttach(benchmark::State& state, std::string const& dataset, std::string sizeSuffix,
+                     AttachHint hint) {
+  auto const& predValue = predicateValues[dataset][1];
+  auto const& predColumnStr = predicateColumnMap[dataset];
+  auto const& aggColumnStr = aggregateColumnMap[dataset];
+  SharedMemoryData data(dataset, sizeSuffix); // (loaded by the server)
+  auto mapping = segmentMapping();
+  mapping.populate = mapping.populate || hint == AttachHint::populate;
+  auto [minorFaults, majorFaults] = pageFaults();
+  vtune.startSampling("WisentAttach");
+  auto agg = 0.0;
+  for(auto _ : state) {
+    auto entry = findDataset(dataset); // (as a reader discovering the dataset)
+    SharedMemorySegment segment(entry.description.segmentName, segmentDirectory(), mapping);
+    segment.load();
+    auto* root = reinterpret_cast<WisentRootExpression*>(
+        static_cast<char*>(segment.baseAddress()) + entry.description.offset);
+    if(hint == AttachHint::advise) {
+      auto table = LazyExpression(root, 0)["resources"][0]["Object"]["path"]["Table"];
+      for(auto const* columnName : {&aggColumnStr, &predColumnStr}) {
+        auto column = getExpression(root, table[*columnName].expressionIndex());
+        adviseArguments(root, column.startChildOffset, column.endChildOffset, MADV_SEQUENTIAL);
+        adviseArguments(root, column.startChildOffset, column.endChildOffset, MADV_WILLNEED);
+      }
+    }
+    agg = aggregateWisent(root, aggColumnStr, predColumnStr, predValue);
+    benchmark::DoNotOptimize(agg);
+  }
+  vtune.stopSampling();
+  auto [minorFaultsAfter, majorFaultsAfter] = pageFaults();
+  state.counters["MinorFaults"] = benchmark::Counter(
+      static_cast<double>(minorFaultsAfter - minorFaults), benchmark::Counter::kAvgIterations);
+  state.counters["MajorFaults"] = benchmark::Counter(
+      static_cast<double>(majorFaultsAfter - majorFaults), benchmark::Counter::kAvgIterations);
+  if(VERBOSE) {
+    std::cout << "output: agg=" << agg << std::endl;
+  }
+}
+
+enum class AttachChannel { http, controlSocket };
+
+/* request a loaded dataset and map it on every iteration, as a client attaching to it: with an
+ * HTTP request (then finding its segment in the catalog and opening it by name), or with a
+ * command on the control socket replying with the segment's descriptor */
+void runWisentAttachLatency(benchmark::State& state, std::string const& dataset,
+                            std::string sizeSuffix, AttachChannel channel) {
+  SharedMemoryData data(dataset, sizeSuffix); // (loaded by the server)
+  auto filepath = "../Data/" + dataset + "/datapackage" + sizeSuffix + ".json";
+  uint64_t argumentCount = 0;
+  for(auto _ : state) {
+    if(channel == AttachChannel::http) {
+      httplib::Client client("localhost", 3000);
+      httplib::Params params = {{"name", dataset}, {"path", filepath}};
+      auto response = client.Get("/load", params, httplib::Headers());
+      if(!response || response->status != 200) {
+        throw std::runtime_error("failed to request '" + dataset + "'");
+      }
+      auto entry = findDataset(dataset);
+      SharedMemorySegment segment(entry.description.segmentName, segmentDirectory());
+      segment.load();
+      argumentCount = reinterpret_cast<WisentRootExpression*>(
+                          static_cast<char*>(segment.baseAddress()) + entry.description.offset)
+                          ->argumentCount;
+    } else {
+      auto reply = runCommands(
+          {{WISENT_CONTROL_LOAD, WISENT_CONTROL_PASS_DESCRIPTOR, dataset, filepath}})[0];
+      auto size = reply.offset + reply.size;
+      auto* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, reply.descriptor, 0);
+      close(reply.descriptor);
+      if(address == MAP_FAILED) {
+        throw std::runtime_error("failed to map '" + dataset + "'");
+      }
+      argumentCount =
+          reinterpret_cast<WisentRootExpression*>(static_cast<char*>(address) + reply.offset)
+              ->argumentCount;
+      munmap(address, size);
+    }
+    benchmark::DoNotOptimize(argumentCount);
+  }
+}
+
 template <typename... Args>
 benchmark::internal::Benchmark* RegisterBenchmarkNolint([[maybe_unused]] Args... args) {
 #ifdef __clang_analyzer__
@@ -469,6 +892,22 @@ void initAndRunBenchmarks(int argc, char** argv) {
     if(std::string(argv[i]) == "--verbose") {
       VERBOSE = true;
     }
+    if(std::string(argv[i]) == "--segment-dir" && i + 1 < argc) {
+      setSegmentDirectory(argv[++i]); // file-backed segments (as the server's --segment-dir)
+    }
+    if(std::string(argv[i]) == "--control-socket" && i + 1 < argc) {
+      CONTROL_SOCKET = argv[++i];
+    }
+    if(std::string(argv[i]) == "--transparent-huge-pages") {
+      auto mapping = segmentMapping();
+      mapping.transparentHugePages = true;
+      setSegmentMapping(mapping);
+    }
+    if(std::string(argv[i]) == "--populate") {
+      auto mapping = segmentMapping();
+      mapping.populate = true;
+      setSegmentMapping(mapping);
+    }
   }
   // register smaller size variations
   for(std::string const& dataset : std::vector<std::string>{"owid-deaths", "opsd-weather"}) {
@@ -479,6 +918,8 @@ void initAndRunBenchmarks(int argc, char** argv) {
         name << dataset << ",size:" << sizeSuffix << ",selectivity:1/" << selectivityFraction;
         RegisterBenchmarkNolint(("Wisent," + name.str()).c_str(), runWisent, dataset, sizeSuffix,
                                 selectivityFraction);
+        RegisterBenchmarkNolint(("WisentCompiledPath," + name.str()).c_str(),
+                                runWisentCompiledPath, dataset, sizeSuffix, selectivityFraction);
         RegisterBenchmarkNolint(("JsonCsv," + name.str()).c_str(), runJsonCsv, dataset, sizeSuffix,
                                 selectivityFraction);
         RegisterBenchmarkNolint(("Json," + name.str()).c_str(), runJson, dataset, sizeSuffix,
@@ -501,6 +942,10 @@ void initAndRunBenchmarks(int argc, char** argv) {
         name << dataset << ",size:" << sizeSuffix << ",selectivity:1/" << selectivityFraction;
         RegisterBenchmarkNolint(("Wisent," + name.str()).c_str(), runWisent, dataset, sizeSuffix,
                                 selectivityFraction);
+        RegisterBenchmarkNolint(("WisentCompiledPath," + name.str()).c_str(),
+                                runWisentCompiledPath, dataset, sizeSuffix, selectivityFraction);
+        RegisterBenchmarkNolint(("WisentZoneMaps," + name.str()).c_str(), runWisentZoneMaps,
+                                dataset, sizeSuffix, selectivityFraction);
         RegisterBenchmarkNolint(("JsonCsv," + name.str()).c_str(), runJsonCsv, dataset, sizeSuffix,
                                 selectivityFraction);
         RegisterBenchmarkNolint(("Json," + name.str()).c_str(), runJson, dataset, sizeSuffix,
@@ -514,6 +959,91 @@ void initAndRunBenchmarks(int argc, char** argv) {
       }
     }
   }
+  // register the attach benchmarks (mapping the segment and scanning on every iteration)
+  for(std::string const& dataset : std::vector<std::string>{"owid-deaths", "opsd-weather"}) {
+    for(std::string const& sizeSuffix : std::vector<std::string>{
+            "_scale1", "_scale2", "_scale4", "_scale8", "_scale16", "_scale32", "_scale64"}) {
+      std::ostringstream name;
+      name << dataset << ",size:" << sizeSuffix;
+      RegisterBenchmarkNolint(("WisentAttach," + name.str()).c_str(), runWisentAttach, dataset,
+                              sizeSuffix, AttachHint::none);
+      RegisterBenchmarkNolint(("WisentAttachPopulate," + name.str()).c_str(), runWisentAttach,
+                              dataset, sizeSuffix, AttachHint::populate);
+      RegisterBenchmarkNolint(("WisentAttachAdvise," + name.str()).c_str(), runWisentAttach,
+                              dataset, sizeSuffix, AttachHint::advise);
+    }
+  }
+  // register the attach latency benchmarks (a request per attach: HTTP or the control socket)
+  for(std::string const& dataset : std::vector<std::string>{"owid-deaths", "opsd-weather"}) {
+    RegisterBenchmarkNolint(("WisentAttachHttp," + dataset + ",size:_scale1").c_str(),
+                            runWisentAttachLatency, dataset, "_scale1", AttachChannel::http);
+    if(!CONTROL_SOCKET.empty()) {
+      RegisterBenchmarkNolint(("WisentAttachSocket," + dataset + ",size:_scale1").c_str(),
+                              runWisentAttachLatency, dataset, "_scale1",
+                              AttachChannel::controlSocket);
+    }
+  }
+  // register the key lookup benchmarks (the table's width does not depend on the size)
+  for(std::string const& dataset : std::vector<std::string>{"owid-deaths", "opsd-weather"}) {
+    RegisterBenchmarkNolint(("WisentKeyLookup," + dataset + ",size:_scale1").c_str(),
+                            runWisentKeyLookup, dataset, "_scale1");
+  }
+  // register the serialization (load path) benchmarks
+  for(std::string const& dataset : std::vector<std::string>{"owid-deaths", "opsd-weather"}) {
+    for(std::string const& sizeSuffix :
+        std::vector<std::string>{"_div256", "_div128", "_div64", "_div32", "_div16", "_div8",
+                                 "_div4", "_div2", "_scale1", "_scale2", "_scale4", "_scale8",
+                                 "_scale16", "_scale32", "_scale64"}) {
+      std::ostringstream name;
+      name << dataset << ",size:" << sizeSuffix;
+      wisent::serializer::LoadOptions twoPass;
+      RegisterBenchmarkNolint(("WisentLoad," + name.str()).c_str(), runWisentLoad, dataset,
+                              sizeSuffix, twoPass);
+      wisent::serializer::LoadOptions singlePass;
+      singlePass.singlePass = true;
+      RegisterBenchmarkNolint(("WisentLoadSinglePass," + name.str()).c_str(), runWisentLoad,
+                              dataset, sizeSuffix, singlePass);
+      wisent::serializer::LoadOptions simdjsonParser;
+      simdjsonParser.parser = wisent::serializer::JsonParser::simdjson;
+      RegisterBenchmarkNolint(("WisentLoadSimdJson," + name.str()).c_str(), runWisentLoad,
+                              dataset, sizeSuffix, simdjsonParser);
+      wisent::serializer::LoadOptions nativeCsv;
+      nativeCsv.csvParser = wisent::serializer::CsvParser::native;
+      RegisterBenchmarkNolint(("WisentLoadNativeCsv," + name.str()).c_str(), runWisentLoad,
+                              dataset, sizeSuffix, nativeCsv);
+      wisent::serializer::LoadOptions formatV2;
+      formatV2.formatVersion = WISENT_FORMAT_VERSION_2;
+      formatV2.compactOffsets = true;
+      RegisterBenchmarkNolint(("WisentLoadFormatV2," + name.str()).c_str(), runWisentLoad,
+                              dataset, sizeSuffix, formatV2);
+      wisent::serializer::LoadOptions nullBitmap;
+      nullBitmap.formatVersion = WISENT_FORMAT_VERSION_2;
+      nullBitmap.nullBitmap = true;
+      nullBitmap.nativeBooleans = true;
+      RegisterBenchmarkNolint(("WisentLoadNullBitmap," + name.str()).c_str(), runWisentLoad,
+                              dataset, sizeSuffix, nullBitmap);
+      wisent::serializer::LoadOptions zoneMaps;
+      zoneMaps.formatVersion = WISENT_FORMAT_VERSION_2;
+      zoneMaps.zoneMapBlockSize = 4096;
+      RegisterBenchmarkNolint(("WisentLoadZoneMaps," + name.str()).c_str(), runWisentLoad,
+                              dataset, sizeSuffix, zoneMaps);
+      RegisterBenchmarkNolint(("WisentWarmRestart," + name.str()).c_str(), runWisentWarmRestart,
+                              dataset, sizeSuffix);
+    }
+  }
+  // register the concurrent load benchmarks (scaling with the number of datasets loaded at once)
+  for(std::string const& dataset : std::vector<std::string>{"owid-deaths", "opsd-weather"}) {
+    for(std::string const& sizeSuffix : std::vector<std::string>{"_scale1", "_scale8"}) {
+      auto* benchmark = RegisterBenchmarkNolint(
+          ("WisentConcurrentLoad," + dataset + ",size:" + sizeSuffix).c_str(),
+          runWisentConcurrentLoad, dataset, sizeSuffix);
+      if(benchmark != nullptr) {
+        benchmark->RangeMultiplier(2)
+            ->Range(1, std::max<int64_t>(1, std::thread::hardware_concurrency()))
+            ->UseRealTime();
+      }
+    }
+  }
   // initialise and run google benchmark
   ::benchmark::Initialize(&argc, argv);
   ::benchmark::RunSpecifiedBenchmarks();
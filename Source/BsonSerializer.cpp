@@ -9,20 +9,26 @@
 
 using json = nlohmann::json;
 
+/* allocates the (single) buffer of a container in the given segment */
 template <class T> struct SharedMemoryAllocator {
   typedef T value_type;
 
-  SharedMemoryAllocator() : pointer(nullptr), size(0) {}
+  explicit SharedMemoryAllocator(SharedMemorySegment& segment)
+      : segment(&segment), pointer(nullptr), size(0) {}
 
   template <class U>
   SharedMemoryAllocator(const SharedMemoryAllocator<U>& other)
-      : pointer(other.pointer), size(other.size) {}
+      : segment(other.segment), pointer(other.pointer), size(other.size) {}
   template <class U>
   SharedMemoryAllocator(SharedMemoryAllocator<U>&& other)
-      : pointer(std::move(other.pointer)), size(std::move(other.size)) {}
+      : segment(other.segment), pointer(std::move(other.pointer)), size(std::move(other.size)) {}
 
-  template <typename U> bool operator==(SharedMemoryAllocator<U> const& other) { return true; }
-  template <typename U> bool operator!=(SharedMemoryAllocator<U> const& other) { return false; }
+  template <typename U> bool operator==(SharedMemoryAllocator<U> const& other) {
+    return segment == other.segment;
+  }
+  template <typename U> bool operator!=(SharedMemoryAllocator<U> const& other) {
+    return segment != other.segment;
+  }
 
   T* allocate(std::size_t n) {
     if(n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
@@ -33,9 +39,9 @@ template <class T> struct SharedMemoryAllocator {
       if(newSize < size) {
         return static_cast<T*>(pointer);
       }
-      pointer = sharedMemoryRealloc(pointer, newSize);
+      pointer = segment->realloc(pointer, newSize);
     } else {
-      pointer = sharedMemoryMalloc(newSize);
+      pointer = segment->malloc(newSize);
     }
     if(pointer == nullptr) {
       throw std::bad_alloc();
@@ -49,6 +55,8 @@ template <class T> struct SharedMemoryAllocator {
   }
 
 private:
+  template <class U> friend struct SharedMemoryAllocator;
+  SharedMemorySegment* segment;
   void* pointer;
   size_t size;
 };
@@ -90,47 +98,35 @@ json load(std::string const& path, std::string const& csvPrefix, bool disableCsv
 void* bson::serializer::loadAsBson(std::string const& path, std::string const& sharedMemoryName,
                                    std::string const& csvPrefix, bool disableCsvHandling,
                                    bool forceReload) {
-  auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
-  if(sharedMemory.loaded()) {
-    if(!forceReload) {
-      return sharedMemory.baseAddress();
-    }
-    free(sharedMemoryName);
-  }
-  setCurrentSharedMemory(sharedMemory);
-  auto j = load(path, csvPrefix, disableCsvHandling);
-  auto v = json::to_bson(j);
-  std::vector<std::uint8_t, SharedMemoryAllocator<std::uint8_t>> sharedV(v.begin(), v.end());
-  return sharedV.data();
+  return loadOrBuildMemorySegment(sharedMemoryName, forceReload, [&](SharedMemorySegment& next) {
+    auto j = load(path, csvPrefix, disableCsvHandling);
+    auto v = json::to_bson(j);
+    std::vector<std::uint8_t, SharedMemoryAllocator<std::uint8_t>> sharedV(
+        v.begin(), v.end(), SharedMemoryAllocator<std::uint8_t>(next));
+  });
 }
 
 void* bson::serializer::loadAsJson(std::string const& path, std::string const& sharedMemoryName,
                                    std::string const& csvPrefix, bool disableCsvHandling,
                                    bool forceReload) {
-  auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
-  if(sharedMemory.loaded()) {
-    if(!forceReload) {
-      return sharedMemory.baseAddress();
-    }
-    free(sharedMemoryName);
-  }
-  setCurrentSharedMemory(sharedMemory);
-  auto j = load(path, csvPrefix, disableCsvHandling);
-  std::ostringstream ostream;
-  ostream << j;
-  std::basic_string<char, std::char_traits<char>, SharedMemoryAllocator<char>> str;
-  str = std::move(ostream).str();
-  return str.data();
+  return loadOrBuildMemorySegment(sharedMemoryName, forceReload, [&](SharedMemorySegment& next) {
+    auto j = load(path, csvPrefix, disableCsvHandling);
+    std::ostringstream ostream;
+    ostream << j;
+    std::basic_string<char, std::char_traits<char>, SharedMemoryAllocator<char>> str(
+        (SharedMemoryAllocator<char>(next)));
+    str = std::move(ostream).str();
+  });
 }
 
 void bson::serializer::unload(std::string const& sharedMemoryName) {
+  auto lock = lockMemorySegment(sharedMemoryName);
   auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
   assert(sharedMemory.loaded());
   sharedMemory.unload();
 }
 
 void bson::serializer::free(std::string const& sharedMemoryName) {
-  auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
-  sharedMemory.erase();
-  sharedMemorySegments().erase(sharedMemoryName);
+  auto lock = lockMemorySegment(sharedMemoryName);
+  freeMemorySegment(sharedMemoryName);
 }
@@ -0,0 +1,313 @@
+#include "ControlChannel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using wisent::control::Command;
+using wisent::control::ControlClient;
+using wisent::control::ControlServer;
+using wisent::control::Reply;
+
+namespace {
+std::runtime_error socketError(std::string const& what, std::string const& path) {
+  return std::runtime_error(what + " (control socket '" + path + "'): " + std::strerror(errno));
+}
+
+sockaddr_un socketAddress(std::string const& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("control socket path too long: " + path);
+  }
+  path.copy(address.sun_path, path.size());
+  return address;
+}
+
+/* read exactly size bytes, collecting the descriptors passed with them
+ * returns false if the peer closed the connection before the first byte */
+bool receive(int socket, void* buffer, size_t size, std::vector<int>* descriptors = nullptr) {
+  auto* bytes = static_cast<char*>(buffer);
+  for(size_t received = 0; received < size;) {
+    iovec data{bytes + received, size - received};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * WISENT_CONTROL_MAX_COMMANDS)];
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    auto count = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if(count < 0 && errno == EINTR) {
+      continue;
+    }
+    if(count < 0) {
+      throw std::runtime_error(std::string("control socket: ") + std::strerror(errno));
+    }
+    for(auto* header = CMSG_FIRSTHDR(&message); header != nullptr;
+        header = CMSG_NXTHDR(&message, header)) {
+      if(header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      auto descriptorCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto const* first = reinterpret_cast<int const*>(CMSG_DATA(header));
+      for(size_t i = 0; i < descriptorCount; ++i) {
+        if(descriptors != nullptr) {
+          descriptors->push_back(first[i]);
+        } else {
+          close(first[i]); // (unexpected)
+        }
+      }
+    }
+    if(count == 0) {
+      if(received == 0) {
+        return false;
+      }
+      throw std::runtime_error("control socket: connection closed in a message");
+    }
+    received += count;
+  }
+  return true;
+}
+
+/* read the rest of a message (its end: the peer closing the connection is an error) */
+void receiveRest(int socket, void* buffer, size_t size, std::vector<int>* descriptors = nullptr) {
+  if(!receive(socket, buffer, size, descriptors)) {
+    throw std::runtime_error("control socket: connection closed in a message");
+  }
+}
+
+/* write the buffer, passing the descriptors with its first bytes */
+void transmit(int socket, std::string const& buffer, std::vector<int> const& descriptors = {}) {
+  size_t sent = 0;
+  if(!descriptors.empty()) {
+    iovec data{const_cast<char*>(buffer.data()), buffer.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * WISENT_CONTROL_MAX_COMMANDS)]{};
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * descriptors.size());
+    auto* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * descriptors.size());
+    memcpy(CMSG_DATA(header), descriptors.data(), sizeof(int) * descriptors.size());
+    ssize_t count = 0;
+    do {
+      count = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while(count < 0 && errno == EINTR);
+    if(count < 0) {
+      throw std::runtime_error(std::string("control socket: ") + std::strerror(errno));
+    }
+    sent = count;
+  }
+  while(sent < buffer.size()) {
+    auto count = ::send(socket, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+    if(count < 0 && errno == EINTR) {
+      continue;
+    }
+    if(count < 0) {
+      throw std::runtime_error(std::string("control socket: ") + std::strerror(errno));
+    }
+    sent += count;
+  }
+}
+
+template <typename T> void append(std::string& buffer, T const& value) {
+  buffer.append(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+} // namespace
+
+ControlServer::ControlServer(std::string path, Handler handler)
+    : path(std::move(path)), handler(std::move(handler)) {
+  auto address = socketAddress(this->path);
+  listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(listener < 0) {
+    throw socketError("failed to create", this->path);
+  }
+  unlink(this->path.c_str()); // (left by a previous run)
+  // (only the server's user connects: restricted before listening)
+  if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+     chmod(this->path.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+    close(listener);
+    throw socketError("failed to listen", this->path);
+  }
+}
+
+ControlServer::~ControlServer() {
+  stop();
+  std::vector<std::thread> connectionThreads;
+  {
+    std::lock_guard lock(mutex);
+    std::swap(connectionThreads, threads);
+  }
+  for(auto& thread : connectionThreads) {
+    thread.join();
+  }
+  close(listener);
+  unlink(path.c_str());
+}
+
+void ControlServer::listen() {
+  for(;;) {
+    auto connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    std::lock_guard lock(mutex);
+    if(stopped) {
+      if(connection >= 0) {
+        close(connection);
+      }
+      return;
+    }
+    if(connection < 0) {
+      continue; // (EINTR, ECONNABORTED, ...)
+    }
+    joinFinishedThreads();
+    connections.push_back(connection);
+    threads.emplace_back([this, connection]() { serve(connection); });
+  }
+}
+
+void ControlServer::joinFinishedThreads() {
+  for(auto id : finishedThreads) {
+    auto thread = std::find_if(threads.begin(), threads.end(),
+                               [id](auto const& candidate) { return candidate.get_id() == id; });
+    thread->join(); // (returning: it no longer takes the mutex)
+    threads.erase(thread);
+  }
+  finishedThreads.clear();
+}
+
+void ControlServer::stop() {
+  std::lock_guard lock(mutex);
+  stopped = true;
+  shutdown(listener, SHUT_RDWR); // (wakes listen())
+  for(auto connection : connections) {
+    shutdown(connection, SHUT_RD); // (the replies being sent still go out)
+  }
+}
+
+void ControlServer::serve(int connection) {
+  try {
+    WisentControlBatch batch{};
+    while(receive(connection, &batch, sizeof(batch))) {
+      if(batch.magic != WISENT_CONTROL_MAGIC || batch.count > WISENT_CONTROL_MAX_COMMANDS) {
+        break; // (not a client of this protocol)
+      }
+      std::vector<Command> commands(batch.count);
+      for(auto& command : commands) {
+        WisentControlCommand header{};
+        receiveRest(connection, &header, sizeof(header));
+        if(header.pathSize > PATH_MAX) {
+          throw std::runtime_error("control socket: path too long");
+        }
+        command.command = header.command;
+        command.flags = header.flags;
+        command.name.assign(header.name, strnlen(header.name, WISENT_DATASET_NAME_SIZE));
+        command.path.resize(header.pathSize);
+        receiveRest(connection, command.path.data(), command.path.size());
+      }
+      std::string buffer;
+      std::vector<int> descriptors;
+      append(buffer, batch);
+      for(auto const& command : commands) {
+        Reply reply;
+        try {
+          reply = handler(command);
+        } catch(std::exception const& e) {
+          reply.status = 1;
+          reply.error = e.what();
+        }
+        WisentControlReply header{};
+        header.status = reply.status;
+        header.errorSize = reply.error.size();
+        header.hasDescriptor = reply.descriptor >= 0 ? 1 : 0;
+        header.offset = reply.offset;
+        header.size = reply.size;
+        append(buffer, header);
+        buffer += reply.error;
+        if(reply.descriptor >= 0) {
+          descriptors.push_back(reply.descriptor);
+        }
+      }
+      try {
+        transmit(connection, buffer, descriptors);
+      } catch(...) {
+        for(auto descriptor : descriptors) {
+          close(descriptor);
+        }
+        throw;
+      }
+      for(auto descriptor : descriptors) {
+        close(descriptor);
+      }
+    }
+  } catch(std::exception const&) {
+    // (the client disconnected or broke the protocol: drop the connection)
+  }
+  std::lock_guard lock(mutex);
+  connections.erase(std::find(connections.begin(), connections.end(), connection));
+  close(connection);
+  finishedThreads.push_back(std::this_thread::get_id());
+}
+
+ControlClient::ControlClient(std::string const& path) {
+  auto address = socketAddress(path);
+  socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(socket < 0) {
+    throw socketError("failed to create", path);
+  }
+  if(connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    close(socket);
+    throw socketError("failed to connect", path);
+  }
+}
+
+ControlClient::~ControlClient() { close(socket); }
+
+std::vector<Reply> ControlClient::send(std::vector<Command> const& commands) {
+  if(commands.size() > WISENT_CONTROL_MAX_COMMANDS) {
+    throw std::runtime_error("too many commands in a batch: " + std::to_string(commands.size()));
+  }
+  std::string buffer;
+  append(buffer, WisentControlBatch{WISENT_CONTROL_MAGIC, static_cast<uint32_t>(commands.size()),
+                                    0});
+  for(auto const& command : commands) {
+    if(command.name.size() >= WISENT_DATASET_NAME_SIZE) {
+      throw std::runtime_error("dataset name too long: " + command.name);
+    }
+    WisentControlCommand header{};
+    command.name.copy(header.name, WISENT_DATASET_NAME_SIZE - 1);
+    header.command = command.command;
+    header.flags = command.flags;
+    header.pathSize = command.path.size();
+    append(buffer, header);
+    buffer += command.path;
+  }
+  transmit(socket, buffer);
+  WisentControlBatch batch{};
+  std::vector<int> descriptors;
+  if(!receive(socket, &batch, sizeof(batch), &descriptors) ||
+     batch.magic != WISENT_CONTROL_MAGIC || batch.count != commands.size()) {
+    throw std::runtime_error("control socket: unexpected reply");
+  }
+  std::vector<Reply> replies(batch.count);
+  size_t nextDescriptor = 0;
+  for(auto& reply : replies) {
+    WisentControlReply header{};
+    receiveRest(socket, &header, sizeof(header), &descriptors);
+    reply.status = header.status;
+    reply.offset = header.offset;
+    reply.size = header.size;
+    reply.error.resize(header.errorSize);
+    receiveRest(socket, reply.error.data(), reply.error.size(), &descriptors);
+    if(header.hasDescriptor != 0 && nextDescriptor < descriptors.size()) {
+      reply.descriptor = descriptors[nextDescriptor++];
+    }
+  }
+  return replies;
+}
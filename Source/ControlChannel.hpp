@@ -0,0 +1,79 @@
+#pragma once
+#include "WisentHelpers.h"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wisent {
+namespace control {
+struct Command {
+  uint32_t command = WISENT_CONTROL_LOAD;
+  uint32_t flags = 0;
+  std::string name;
+  std::string path; // (loads only)
+};
+
+struct Reply {
+  uint32_t status = 0; // 0: done
+  std::string error;
+  int descriptor = -1; // (owned by the receiver: close it)
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+/**
+ * The server side of the control socket: a Unix domain socket receiving batches of commands
+ * (WisentControlBatch in 'WisentHelpers.h'), without the HTTP parsing nor the TCP connection.
+ * Each connection is served on its own thread, running its batches' commands in order with the
+ * handler; the handler's descriptors are passed with the replies (and closed after). The threads
+ * of the closed connections are joined on the next accepted connection.
+ */
+class ControlServer {
+public:
+  using Handler = std::function<Reply(Command const&)>;
+
+  ControlServer(std::string path, Handler handler); // throws std::runtime_error
+  ~ControlServer();
+
+  ControlServer(ControlServer const& other) = delete;
+  ControlServer(ControlServer&& other) = delete;
+  ControlServer& operator=(ControlServer const& other) = delete;
+  ControlServer& operator=(ControlServer&& other) = delete;
+
+  void listen(); // until stop() (from any thread)
+  void stop();
+
+private:
+  void serve(int connection);
+  void joinFinishedThreads(); // (holding the mutex)
+
+  std::string path;
+  Handler handler;
+  int listener;
+  std::mutex mutex; // guards the connections
+  std::vector<int> connections;
+  std::vector<std::thread> threads;
+  std::vector<std::thread::id> finishedThreads; // (served their connection, not joined yet)
+  bool stopped = false;
+};
+
+/* a connection to the control socket, sending a batch of commands per round trip */
+class ControlClient {
+public:
+  explicit ControlClient(std::string const& path); // throws std::runtime_error
+  ~ControlClient();
+
+  ControlClient(ControlClient const& other) = delete;
+  ControlClient(ControlClient&& other) = delete;
+  ControlClient& operator=(ControlClient const& other) = delete;
+  ControlClient& operator=(ControlClient&& other) = delete;
+
+  std::vector<Reply> send(std::vector<Command> const& commands); // (in order)
+
+private:
+  int socket;
+};
+} // namespace control
+} // namespace wisent
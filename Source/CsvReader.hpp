@@ -0,0 +1,215 @@
+#pragma once
+#include "MappedFile.hpp"
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Native CSV reader: memory-maps the file and splits it into field spans in a single scan
+ * (header row for the column names, comma separated, double-quoted fields with "" escapes)
+ * its values are typed as rapidcsv's (std::stol/std::stod of the unquoted field, an empty field
+ * is missing), except that a quoted field may span lines, the values out of the int64 range are
+ * doubles (instead of failing the load), and the empty lines of files with several columns are
+ * skipped (instead of failing the load) */
+class CsvReader {
+public:
+  enum class ColumnType { Integer, Double, String };
+
+private:
+  MappedFile file;
+  std::vector<std::string> columnNames;
+  std::vector<uint64_t> rowStarts; // (offsets in the file)
+  /* row-major, the end of each field relative to its row's start (the next field starts after
+   * its comma; missing trailing fields are empty), as raw text: quoted fields keep their quotes */
+  std::vector<uint32_t> fieldEnds;
+  size_t rowCount = 0;
+
+public:
+  explicit CsvReader(std::string const& path) : file(path) {
+    std::vector<std::string_view> row;
+    bool header = true;
+    split([&](std::string_view field, bool endOfRow) {
+      row.push_back(field);
+      if(!endOfRow) {
+        return;
+      }
+      if(row.size() == 1 && row[0].empty() && (header || columnNames.size() > 1)) {
+        row.clear(); // skip empty lines (a missing value of a single column)
+        return;
+      }
+      if(header) {
+        for(auto const& name : row) {
+          std::string columnName;
+          appendUnquoted(columnName, name);
+          columnNames.emplace_back(std::move(columnName));
+        }
+        header = false;
+      } else {
+        auto const* rowStart = row.front().data();
+        rowStarts.push_back(rowStart - file.data());
+        uint64_t end = 0;
+        for(size_t column = 0; column < columnNames.size(); ++column) {
+          // (missing trailing fields: empty)
+          end = column < row.size() ? row[column].data() + row[column].size() - rowStart
+                                    : end + 1;
+          if(end > UINT32_MAX) {
+            throw std::runtime_error("csv row longer than 4 GB");
+          }
+          fieldEnds.push_back(static_cast<uint32_t>(end));
+        }
+        ++rowCount;
+      }
+      row.clear();
+    });
+  }
+
+  std::vector<std::string> const& getColumnNames() const { return columnNames; }
+  size_t getColumnCount() const { return columnNames.size(); }
+  size_t getRowCount() const { return rowCount; }
+  std::string_view getField(size_t row, size_t column) const {
+    auto const* ends = &fieldEnds[row * columnNames.size()];
+    auto start = column > 0 ? ends[column - 1] + 1 : 0;
+    return std::string_view(file.data() + rowStarts[row] + start, ends[column] - start);
+  }
+  /* empty, or quoted empty: a missing value */
+  static bool isEmpty(std::string_view field) { return field.empty() || field == "\"\""; }
+
+  /* narrowest type (int64 -> double -> string) holding all the non-empty fields of a column */
+  ColumnType inferColumnType(size_t column) const {
+    auto type = ColumnType::Integer;
+    for(size_t row = 0; row < rowCount; ++row) {
+      auto field = getField(row, column);
+      if(isEmpty(field)) {
+        continue;
+      }
+      if(type == ColumnType::Integer && !parseInteger(field)) {
+        type = ColumnType::Double;
+      }
+      if(type == ColumnType::Double && !parseDouble(field)) {
+        return ColumnType::String;
+      }
+    }
+    return type;
+  }
+
+  static std::optional<int64_t> parseInteger(std::string_view field) {
+    return parseNumber<int64_t>(field);
+  }
+  static std::optional<double> parseDouble(std::string_view field) {
+    return parseNumber<double>(field);
+  }
+
+  /* append a field's value, removing the enclosing quotes and unescaping the inner ones */
+  static void appendUnquoted(std::string& output, std::string_view field) {
+    if(field.size() < 2 || field.front() != '"' || field.back() != '"') {
+      output.append(field);
+      return;
+    }
+    field = field.substr(1, field.size() - 2);
+    for(auto quote = field.find('"'); quote != std::string_view::npos; quote = field.find('"')) {
+      output.append(field.substr(0, quote + 1));
+      field.remove_prefix(std::min(quote + 2, field.size()));
+    }
+    output.append(field);
+  }
+
+private:
+  /* as std::stol/std::stod: the unquoted field after any leading whitespace, a sign, and for
+   * doubles "0x" hexadecimals */
+  template <typename T> static std::optional<T> parseNumber(std::string_view field) {
+    if(field.size() >= 2 && field.front() == '"' && field.back() == '"') {
+      field = field.substr(1, field.size() - 2);
+    }
+    while(!field.empty() && std::isspace(static_cast<unsigned char>(field.front()))) {
+      field.remove_prefix(1);
+    }
+    if(!field.empty() && field.front() == '+') {
+      field.remove_prefix(1);
+      if(!field.empty() && field.front() == '-') {
+        return {};
+      }
+    }
+    T value;
+    auto digits = field;
+    auto negative = !digits.empty() && digits.front() == '-';
+    digits.remove_prefix(negative ? 1 : 0);
+    std::from_chars_result result{};
+    if constexpr(std::is_floating_point_v<T>) {
+      if(digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') &&
+         digits[2] != '-') {
+        result = std::from_chars(digits.data() + 2, digits.data() + digits.size(), value,
+                                 std::chars_format::hex);
+        value = negative ? -value : value;
+      } else {
+        result = std::from_chars(field.data(), field.data() + field.size(), value);
+      }
+    } else {
+      result = std::from_chars(field.data(), field.data() + field.size(), value);
+    }
+    if(result.ec != std::errc() || result.ptr != field.data() + field.size()) {
+      return {};
+    }
+    return value;
+  }
+
+  /* call onField(field, endOfRow) for each field in the file */
+  template <typename OnField> void split(OnField&& onField) const {
+    auto const* data = file.data();
+    auto size = file.size();
+    size_t fieldStart = 0;
+    bool inQuotes = false;
+    auto onStructural = [&](size_t pos) {
+      auto c = data[pos];
+      if(c == '"') {
+        inQuotes = !inQuotes; // an escaped "" toggles twice
+      } else if(!inQuotes) {
+        auto fieldEnd = pos;
+        if(c == '\n' && fieldEnd > fieldStart && data[fieldEnd - 1] == '\r') {
+          --fieldEnd;
+        }
+        onField(std::string_view(data + fieldStart, fieldEnd - fieldStart), c == '\n');
+        fieldStart = pos + 1;
+      }
+    };
+    size_t pos = 0;
+#ifdef __SSE2__
+    auto const comma = _mm_set1_epi8(',');
+    auto const newline = _mm_set1_epi8('\n');
+    auto const quote = _mm_set1_epi8('"');
+    for(; pos + 16 <= size; pos += 16) {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + pos));
+      auto matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma),
+                                               _mm_cmpeq_epi8(chunk, newline)),
+                                  _mm_cmpeq_epi8(chunk, quote));
+      for(auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches)); mask != 0;
+          mask &= mask - 1) {
+        onStructural(pos + __builtin_ctz(mask));
+      }
+    }
+#endif
+    for(; pos < size; ++pos) {
+      auto c = data[pos];
+      if(c == ',' || c == '\n' || c == '"') {
+        onStructural(pos);
+      }
+    }
+    if(inQuotes) {
+      throw std::runtime_error("unterminated quoted field in csv file");
+    }
+    auto fieldEnd = size;
+    if(fieldEnd > fieldStart && data[fieldEnd - 1] == '\r') {
+      --fieldEnd;
+    }
+    if(fieldStart < size || (size > 0 && data[size - 1] == ',')) {
+      onField(std::string_view(data + fieldStart, fieldEnd - fieldStart), true);
+    }
+  }
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+/* Read-only memory mapping of an input file (the whole file, read sequentially) */
+class MappedFile {
+private:
+  std::unique_ptr<boost::interprocess::file_mapping> file;
+  std::unique_ptr<boost::interprocess::mapped_region> region;
+
+public:
+  explicit MappedFile(std::string const& path) {
+    if(std::filesystem::file_size(path) == 0) {
+      return; // cannot map an empty file
+    }
+    file = std::make_unique<boost::interprocess::file_mapping>(path.c_str(),
+                                                               boost::interprocess::read_only);
+    region = std::make_unique<boost::interprocess::mapped_region>(*file,
+                                                                  boost::interprocess::read_only);
+    region->advise(boost::interprocess::mapped_region::advice_sequential);
+  }
+
+  char const* data() const {
+    return region ? static_cast<char const*>(region->get_address()) : "";
+  }
+  size_t size() const { return region ? region->get_size() : 0; }
+
+  /* whether the bytes following the file's end are readable (i.e., zeroes in the last page) */
+  bool isPaddedBy(size_t padding) const {
+    auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto tail = size() % pageSize;
+    return tail != 0 && pageSize - tail >= padding;
+  }
+};
@@ -0,0 +1,304 @@
+#include "SegmentArena.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static size_t const arenaAlignment = 4096; // allocations start on page boundaries
+
+static uint64_t alignArenaOffset(uint64_t offset) {
+  return (offset + arenaAlignment - 1) & ~uint64_t{arenaAlignment - 1};
+}
+
+static uint64_t const arenaDataStart = alignArenaOffset(sizeof(WisentArenaHeader));
+
+/* makes the sequence of the header odd while the entries are updated (see findArenaEntry()) */
+class EntriesUpdate {
+private:
+  WisentArenaHeader* header;
+
+public:
+  explicit EntriesUpdate(WisentArenaHeader* header) : header(header) {
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+  }
+  ~EntriesUpdate() {
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELEASE);
+  }
+
+  EntriesUpdate(EntriesUpdate const& other) = delete;
+  EntriesUpdate& operator=(EntriesUpdate const& other) = delete;
+};
+
+static std::runtime_error arenaError(std::string const& what, std::string const& name) {
+  return std::runtime_error(what + " (arena '" + name + "'): " + std::strerror(errno));
+}
+
+SegmentArena::SegmentArena(std::string const& name, std::string const& directory,
+                           size_t reservedSize)
+    : name(name), reservedSize(reservedSize) {
+  if(directory.empty()) {
+    fd = shm_open(("/" + name).c_str(), O_RDWR | O_CREAT, 0644);
+  } else {
+    filepath = (std::filesystem::path(directory) / (name + ".wisent")).string();
+    fd = open(filepath.c_str(), O_RDWR | O_CREAT, 0644);
+  }
+  if(fd < 0) {
+    throw arenaError("failed to open the segment", name);
+  }
+  base = static_cast<char*>(
+      mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+  if(base == MAP_FAILED) {
+    close(fd);
+    throw arenaError("failed to reserve " + std::to_string(reservedSize) + " bytes", name);
+  }
+  struct stat status {};
+  fstat(fd, &status);
+  if(status.st_size == 0) {
+    ensureMapped(arenaDataStart);
+    header()->magic = WISENT_ARENA_MAGIC;
+    header()->size = arenaDataStart;
+    return;
+  }
+  ensureMapped(status.st_size);
+  if(static_cast<size_t>(status.st_size) < sizeof(WisentArenaHeader) ||
+     header()->magic != WISENT_ARENA_MAGIC) {
+    munmap(base, reservedSize);
+    close(fd);
+    throw std::runtime_error("not an arena segment: " + name);
+  }
+}
+
+SegmentArena::~SegmentArena() {
+  munmap(base, reservedSize); // (also unmaps the segment's pages mapped in the range)
+  close(fd);
+}
+
+void* SegmentArena::allocate(std::string const& entryName, size_t size) {
+  std::lock_guard lock(mutex);
+  if(findEntry(entryName) != nullptr) {
+    throw std::runtime_error("arena '" + name + "' already has: " + entryName);
+  }
+  return insertAllocation(entryName, size);
+}
+
+void* SegmentArena::insertAllocation(std::string const& entryName, size_t size) {
+  auto offset = findFreeRange(size, nullptr);
+  ensureMapped(offset + size);
+  EntriesUpdate update(header());
+  insertEntry(entryName, offset, size);
+  return base + offset;
+}
+
+void* SegmentArena::reallocate(std::string const& entryName, size_t size) {
+  std::lock_guard lock(mutex);
+  auto* entry = findEntry(entryName);
+  if(entry == nullptr) {
+    return insertAllocation(entryName, size);
+  }
+  auto* next = entry + 1;
+  auto* end = header()->entries + header()->entryCount;
+  auto offset = entry->offset;
+  if(next == end || next->offset >= entry->offset + size) {
+    if(size < entry->size) {
+      // give the pages no longer used back
+      auto unusedStart = alignArenaOffset(offset + size);
+      auto unusedEnd = alignArenaOffset(offset + entry->size);
+      if(unusedStart < unusedEnd) {
+        madvise(base + unusedStart, unusedEnd - unusedStart, MADV_REMOVE);
+      }
+    }
+    ensureMapped(offset + size);
+    EntriesUpdate update(header());
+    entry->size = size;
+    updateSize();
+    return base + offset;
+  }
+  // not enough free space after it: move it (possibly overlapping its previous place)
+  auto newOffset = findFreeRange(size, entry);
+  auto oldSize = entry->size;
+  ensureMapped(newOffset + size);
+  memmove(base + newOffset, base + offset, std::min<size_t>(oldSize, size));
+  EntriesUpdate update(header()); // (moved in a single update: never missing for the readers)
+  auto readerSlot = entry->readerSlot;
+  removeEntry(entry);
+  insertEntry(entryName, newOffset, size)->readerSlot = readerSlot;
+  return base + newOffset;
+}
+
+void SegmentArena::release(std::string const& entryName) {
+  std::lock_guard lock(mutex);
+  auto* entry = findEntry(entryName);
+  if(entry == nullptr) {
+    return;
+  }
+  auto start = alignArenaOffset(entry->offset);
+  auto end = alignArenaOffset(entry->offset + entry->size);
+  {
+    EntriesUpdate update(header());
+    // (after changing the sequence: a reader counted after it sees the change, see
+    // acquireArenaEntry())
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    auto readers = __atomic_load_n(&header()->readers[entry->readerSlot], __ATOMIC_RELAXED);
+    if(readers != 0) {
+      throw std::runtime_error("arena '" + name + "' has " + std::to_string(readers) +
+                               " readers of: " + entryName);
+    }
+    removeEntry(entry);
+  }
+  if(start < end) {
+    madvise(base + start, end - start, MADV_REMOVE); // free the backing pages
+  }
+}
+
+void SegmentArena::swapNames(std::string const& entryName, std::string const& otherName) {
+  std::lock_guard lock(mutex);
+  for(auto const* newName : {&entryName, &otherName}) {
+    if(newName->size() >= WISENT_ARENA_ENTRY_NAME_SIZE) {
+      throw std::runtime_error("arena entry name too long: " + *newName);
+    }
+  }
+  auto* entry = findEntry(entryName);
+  auto* other = findEntry(otherName);
+  EntriesUpdate update(header());
+  if(entry != nullptr) {
+    memset(entry->name, 0, WISENT_ARENA_ENTRY_NAME_SIZE);
+    otherName.copy(entry->name, WISENT_ARENA_ENTRY_NAME_SIZE - 1);
+  }
+  if(other != nullptr) {
+    memset(other->name, 0, WISENT_ARENA_ENTRY_NAME_SIZE);
+    entryName.copy(other->name, WISENT_ARENA_ENTRY_NAME_SIZE - 1);
+  }
+}
+
+void* SegmentArena::find(std::string const& entryName) const {
+  std::lock_guard lock(mutex);
+  auto const* entry = findEntry(entryName);
+  return entry != nullptr ? base + entry->offset : nullptr;
+}
+
+size_t SegmentArena::allocationSize(std::string const& entryName) const {
+  std::lock_guard lock(mutex);
+  auto const* entry = findEntry(entryName);
+  return entry != nullptr ? entry->size : 0;
+}
+
+void SegmentArena::erase() {
+  if(filepath.empty()) {
+    shm_unlink(("/" + name).c_str());
+  } else {
+    std::error_code error;
+    std::filesystem::remove(filepath, error);
+  }
+}
+
+WisentArenaEntry* SegmentArena::findEntry(std::string const& entryName) const {
+  auto* entries = header()->entries;
+  auto* end = entries + header()->entryCount;
+  auto* entry = std::find_if(entries, end, [&entryName](auto const& candidate) {
+    return strncmp(candidate.name, entryName.c_str(), WISENT_ARENA_ENTRY_NAME_SIZE) == 0;
+  });
+  return entry != end ? entry : nullptr;
+}
+
+/* first fit between the allocations (treating the ignored one as free), else at the end */
+uint64_t SegmentArena::findFreeRange(size_t size, WisentArenaEntry const* ignored) const {
+  uint64_t start = arenaDataStart;
+  for(uint64_t i = 0; i < header()->entryCount; ++i) {
+    auto const& entry = header()->entries[i];
+    if(&entry == ignored) {
+      continue;
+    }
+    if(entry.offset >= start + size) {
+      return start;
+    }
+    start = alignArenaOffset(entry.offset + entry.size);
+  }
+  return start;
+}
+
+WisentArenaEntry* SegmentArena::insertEntry(std::string const& entryName, uint64_t offset,
+                                            size_t size) {
+  if(entryName.size() >= WISENT_ARENA_ENTRY_NAME_SIZE) {
+    throw std::runtime_error("arena entry name too long: " + entryName);
+  }
+  if(header()->entryCount == WISENT_ARENA_MAX_ENTRIES) {
+    throw std::runtime_error("arena '" + name + "' is full (" +
+                             std::to_string(WISENT_ARENA_MAX_ENTRIES) + " allocations)");
+  }
+  auto* entries = header()->entries;
+  auto* end = entries + header()->entryCount;
+  auto* entry = std::find_if(entries, end,
+                             [offset](auto const& candidate) { return candidate.offset > offset; });
+  auto readerSlot = findFreeReaderSlot();
+  std::copy_backward(entry, end, end + 1);
+  *entry = {};
+  entryName.copy(entry->name, WISENT_ARENA_ENTRY_NAME_SIZE - 1);
+  entry->offset = offset;
+  entry->size = size;
+  entry->readerSlot = readerSlot;
+  ++header()->entryCount;
+  updateSize();
+  return entry;
+}
+
+/* a reader slot of no entry, preferably without readers (a reader backing off from a changed
+ * entry counts itself in the slot for a moment) */
+uint64_t SegmentArena::findFreeReaderSlot() const {
+  std::vector<bool> used(WISENT_ARENA_MAX_ENTRIES);
+  for(uint64_t i = 0; i < header()->entryCount; ++i) {
+    used[header()->entries[i].readerSlot] = true;
+  }
+  uint64_t freeSlot = 0;
+  for(uint64_t slot = 0; slot < WISENT_ARENA_MAX_ENTRIES; ++slot) {
+    if(!used[slot]) {
+      if(__atomic_load_n(&header()->readers[slot], __ATOMIC_RELAXED) == 0) {
+        return slot;
+      }
+      freeSlot = slot;
+    }
+  }
+  return freeSlot; // (the arena is not full: insertEntry() checked)
+}
+
+void SegmentArena::removeEntry(WisentArenaEntry* entry) {
+  auto* end = header()->entries + header()->entryCount;
+  std::copy(entry + 1, end, entry);
+  --header()->entryCount;
+  updateSize();
+}
+
+/* map the segment's pages up to size (growing it), after the pages already mapped */
+void SegmentArena::ensureMapped(size_t size) {
+  if(size <= mappedSize) {
+    return;
+  }
+  auto newSize = alignArenaOffset(std::max(size, 2 * mappedSize));
+  if(newSize > reservedSize) {
+    throw std::runtime_error("arena '" + name + "' exhausted its reserved address range (" +
+                             std::to_string(reservedSize) + " bytes)");
+  }
+  struct stat status {};
+  fstat(fd, &status);
+  if(static_cast<size_t>(status.st_size) < newSize && ftruncate(fd, newSize) != 0) {
+    throw arenaError("failed to grow the segment", name);
+  }
+  if(mmap(base + mappedSize, newSize - mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+          fd, mappedSize) == MAP_FAILED) {
+    throw arenaError("failed to map the segment", name);
+  }
+  mappedSize = newSize;
+}
+
+void SegmentArena::updateSize() {
+  auto count = header()->entryCount;
+  header()->size = count == 0 ? arenaDataStart
+                              : header()->entries[count - 1].offset +
+                                    header()->entries[count - 1].size;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "WisentHelpers.h"
+#include <mutex>
+#include <string>
+
+/* An arena of named allocations (trees, indexes) in a single segment: POSIX shared memory, or
+ * the file '<directory>/<name>.wisent' if a directory is given (as SharedMemorySegment).
+ * The segment is mapped into an address range reserved up front and grows by mapping its new
+ * pages after the previous ones: it is never remapped, so the addresses stay valid in the
+ * process and the offsets (found by name with findArenaEntry()) stay valid for the readers.
+ * The free space between the allocations (recorded in the segment's WisentArenaHeader) is
+ * reused first-fit. The allocations are thread-safe (each thread writing its own allocations),
+ * but a single process allocates in an arena. */
+class SegmentArena {
+private:
+  std::string name;
+  std::string filepath; // (file-backed only)
+  int fd;
+  char* base;           // start of the reserved address range
+  size_t reservedSize;
+  size_t mappedSize = 0;
+  mutable std::mutex mutex; // guards the entries and the mapping
+
+public:
+  static size_t const defaultReservedSize = size_t{1} << 40;
+
+  explicit SegmentArena(std::string const& name, std::string const& directory = "",
+                        size_t reservedSize = defaultReservedSize);
+  ~SegmentArena();
+
+  SegmentArena(SegmentArena const& other) = delete;
+  SegmentArena(SegmentArena&& other) = delete;
+  SegmentArena& operator=(SegmentArena const& other) = delete;
+  SegmentArena& operator=(SegmentArena&& other) = delete;
+
+  void* allocate(std::string const& entryName, size_t size); // throws if it already exists
+  /* resize in place if the following free space allows it, otherwise move the allocation */
+  void* reallocate(std::string const& entryName, size_t size);
+  void release(std::string const& entryName); // throws if it has readers (acquireArenaEntry())
+  /* exchange the names of two allocations (or rename one if the other is missing) in a single
+   * update of the entries: the readers find either both old names or both new ones */
+  void swapNames(std::string const& entryName, std::string const& otherName);
+  void* find(std::string const& entryName) const; // nullptr if none
+  size_t allocationSize(std::string const& entryName) const; // 0 if none
+
+  char* baseAddress() const { return base; }
+  WisentArenaHeader* header() const { return reinterpret_cast<WisentArenaHeader*>(base); }
+  void erase(); // remove the segment (the arena cannot be used afterwards)
+
+  /* a single named allocation, as the Memory of the serializer (malloc/realloc/free) */
+  class Allocation {
+  private:
+    SegmentArena& arena;
+    std::string entryName;
+
+  public:
+    Allocation(SegmentArena& arena, std::string entryName)
+        : arena(arena), entryName(std::move(entryName)) {}
+    void* malloc(size_t size) { return arena.allocate(entryName, size); }
+    void* realloc(void* /*pointer*/, size_t size) { return arena.reallocate(entryName, size); }
+    void free(void* /*pointer*/) { arena.release(entryName); }
+  };
+
+private:
+  void* insertAllocation(std::string const& entryName, size_t size);
+  WisentArenaEntry* findEntry(std::string const& entryName) const;
+  uint64_t findFreeRange(size_t size, WisentArenaEntry const* ignored) const;
+  WisentArenaEntry* insertEntry(std::string const& entryName, uint64_t offset, size_t size);
+  uint64_t findFreeReaderSlot() const;
+  void removeEntry(WisentArenaEntry* entry);
+  void ensureMapped(size_t size);
+  void updateSize();
+};
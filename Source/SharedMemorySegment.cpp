@@ -1,38 +1,145 @@
 #include "SharedMemorySegment.hpp"
-#include <cassert>
+#include <fcntl.h>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unistd.h>
 #include <unordered_map>
+#include <vector>
 
-std::unordered_map<std::string, SharedMemorySegment>& sharedMemorySegments() {
-  static std::unordered_map<std::string, SharedMemorySegment> segments;
-  return segments;
-}
+namespace {
+/* the segments of the process by name, and a lock per name serializing the operations on it */
+struct SegmentRegistry {
+  std::mutex mutex;
+  std::unordered_map<std::string, SharedMemorySegment> segments;
+  struct Lock {
+    std::mutex mutex;
+    size_t users = 0; // (the threads holding or waiting for it)
+  };
+  std::unordered_map<std::string, Lock> locks; // (dropped once unused)
+};
 
-SharedMemorySegment*& currentSharedMemory() {
-  static SharedMemorySegment* currentSharedMemoryPtr = nullptr;
-  return currentSharedMemoryPtr;
+SegmentRegistry& segmentRegistry() {
+  static SegmentRegistry registry;
+  return registry;
 }
+} // namespace
 
-void setCurrentSharedMemory(SharedMemorySegment& sharedMemory) {
-  currentSharedMemory() = &sharedMemory;
+std::string& segmentDirectoryRef() {
+  static std::string directory;
+  return directory;
 }
 
-void* sharedMemoryMalloc(size_t size) {
-  assert(currentSharedMemory != nullptr);
-  return currentSharedMemory()->malloc(size);
+void setSegmentDirectory(std::string const& directory) { segmentDirectoryRef() = directory; }
+
+std::string const& segmentDirectory() { return segmentDirectoryRef(); }
+
+SegmentMapping& segmentMappingRef() {
+  static SegmentMapping mapping;
+  return mapping;
 }
 
-void* sharedMemoryRealloc(void* pointer, size_t size) {
-  assert(currentSharedMemory != nullptr);
-  return currentSharedMemory()->realloc(pointer, size);
+void setSegmentMapping(SegmentMapping const& mapping) { segmentMappingRef() = mapping; }
+
+SegmentMapping const& segmentMapping() { return segmentMappingRef(); }
+
+int openMemorySegmentDescriptor(std::string const& name) {
+  if(segmentDirectory().empty()) {
+    return shm_open(("/" + name).c_str(), O_RDONLY, 0);
+  }
+  auto filepath = std::filesystem::path(segmentDirectory()) / (name + ".wisent");
+  return open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
 }
 
-void sharedMemoryFree(void* pointer) {
-  assert(currentSharedMemory != nullptr);
-  currentSharedMemory()->free(pointer);
+std::unordered_map<std::string, size_t>
+countMemorySegmentMappings(std::vector<std::string> const& names) {
+  std::error_code error;
+  std::vector<std::pair<std::string, std::string>> paths; // (the file of each segment)
+  std::unordered_map<std::string, size_t> counts;
+  for(auto const& name : names) {
+    if(counts.emplace(name, 0).second) {
+      paths.emplace_back(name, segmentDirectory().empty()
+                                   ? "/dev/shm/" + name
+                                   : std::filesystem::weakly_canonical(
+                                         std::filesystem::path(segmentDirectory()) /
+                                             (name + ".wisent"),
+                                         error)
+                                         .string());
+    }
+  }
+  auto self = std::to_string(getpid());
+  for(auto const& process : std::filesystem::directory_iterator("/proc", error)) {
+    auto pid = process.path().filename().string();
+    if(pid == self || pid.find_first_not_of("0123456789") != std::string::npos) {
+      continue;
+    }
+    std::ifstream maps(process.path() / "maps");
+    std::vector<bool> mapped(paths.size());
+    std::string line;
+    while(std::getline(maps, line)) {
+      for(size_t i = 0; i < paths.size(); ++i) {
+        // (a replaced generation still mapped ends with " (deleted)")
+        auto const& path = paths[i].second;
+        if(!mapped[i] && line.size() > path.size() &&
+           line[line.size() - path.size() - 1] == ' ' &&
+           line.compare(line.size() - path.size(), path.size(), path) == 0) {
+          mapped[i] = true;
+          ++counts[paths[i].first];
+        }
+      }
+    }
+  }
+  return counts;
 }
 
 SharedMemorySegment& createOrGetMemorySegment(std::string const& name) {
-  return sharedMemorySegments().try_emplace(name, name).first->second;
+  auto& registry = segmentRegistry();
+  std::lock_guard lock(registry.mutex);
+  return registry.segments.try_emplace(name, name, segmentDirectory(), segmentMapping())
+      .first->second;
+}
+
+void eraseMemorySegment(std::string const& name) {
+  auto& registry = segmentRegistry();
+  std::lock_guard lock(registry.mutex);
+  registry.segments.erase(name);
+}
+
+void freeMemorySegment(std::string const& name) {
+  createOrGetMemorySegment(name).erase();
+  eraseMemorySegment(name);
+}
+
+SharedMemorySegment& publishMemorySegment(std::string const& nextName, std::string const& name) {
+  auto& registry = segmentRegistry();
+  std::lock_guard lock(registry.mutex);
+  auto node = registry.segments.extract(nextName);
+  node.mapped().replace(name);
+  registry.segments.erase(name); // (unmaps the replaced generation in this process)
+  node.key() = name;
+  return registry.segments.insert(std::move(node)).position->second;
+}
+
+SegmentLock::SegmentLock(std::string name) : name(std::move(name)) {
+  auto& registry = segmentRegistry();
+  std::mutex* segmentMutex = nullptr;
+  {
+    std::lock_guard lock(registry.mutex);
+    auto& entry = registry.locks[this->name];
+    ++entry.users;
+    segmentMutex = &entry.mutex;
+  }
+  segmentMutex->lock();
+}
+
+SegmentLock::~SegmentLock() {
+  auto& registry = segmentRegistry();
+  std::lock_guard lock(registry.mutex);
+  auto entry = registry.locks.find(name);
+  entry->second.mutex.unlock();
+  if(--entry->second.users == 0) {
+    registry.locks.erase(entry);
+  }
 }
+
+SegmentLock lockMemorySegment(std::string const& name) { return SegmentLock(name); }
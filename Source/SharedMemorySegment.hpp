@@ -1,21 +1,57 @@
 #pragma once
+#include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
+#include <filesystem>
+#include <fstream>
+#include <linux/magic.h>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <sys/mman.h>
+#include <sys/vfs.h>
 #include <unordered_map>
+#include <vector>
 
 using namespace boost::interprocess;
 
-/* Not a general implementation: assuming always a single allocation! */
+/* how the segments are mapped into the process */
+struct SegmentMapping {
+  bool transparentHugePages = false; // madvise(MADV_HUGEPAGE): back the mapping by 2 MB pages
+  bool populate = false;             // prefault the whole mapping when loading (MAP_POPULATE)
+};
+
+/* Not a general implementation: assuming always a single allocation!
+ * Backed by a POSIX shared memory object, or by the file '<directory>/<name>.wisent' if a
+ * directory is given: the file persists across restarts and is paged in on demand.
+ * A file is written as '<name>.wisent.partial' until persist() marks it as complete.
+ * In a hugetlbfs directory, the file is backed by the mount's (2 MB or 1 GB) pages and its
+ * size is rounded up to a multiple of the page size. */
 class SharedMemorySegment {
 private:
   shared_memory_object object;
+  std::filesystem::path filepath; // (file-backed only) the file currently mapped
+  std::filesystem::path persistedFilepath;
+  size_t hugePageSize = 0; // (hugetlbfs only)
+  SegmentMapping mapping;
   std::unique_ptr<mapped_region> region;
 
 public:
-  SharedMemorySegment(std::string const& name)
-      : object(open_or_create, name.c_str(), read_write), region(nullptr) {}
+  SharedMemorySegment(std::string const& name, std::string const& directory = "",
+                      SegmentMapping mapping = {})
+      : mapping(mapping), region(nullptr) {
+    if(directory.empty()) {
+      object = shared_memory_object(open_or_create, name.c_str(), read_write);
+      return;
+    }
+    persistedFilepath = std::filesystem::path(directory) / (name + ".wisent");
+    filepath = persistedFilepath;
+    struct statfs filesystem {};
+    if(statfs(directory.c_str(), &filesystem) == 0 && filesystem.f_type == HUGETLBFS_MAGIC) {
+      hugePageSize = filesystem.f_bsize;
+    }
+  }
   SharedMemorySegment(SharedMemorySegment&& other) = default;
   ~SharedMemorySegment() = default;
 
@@ -25,7 +61,11 @@ public:
 
   void* malloc(size_t size) {
     assert(!loaded());
-    object.truncate(size);
+    if(isFileBacked()) {
+      filepath = persistedFilepath.string() + ".partial";
+      std::ofstream(filepath, std::ios::binary | std::ios::trunc); // create it
+    }
+    truncate(size);
     load();
     return baseAddress();
   }
@@ -34,11 +74,44 @@ public:
     assert(loaded());
     assert(pointer == baseAddress());
     unload();
-    object.truncate(size);
+    truncate(size);
     load();
     return baseAddress();
   }
 
+  /* (file-backed only) write the mapped pages back and mark the file as complete
+   * (until then, a restart does not find an interrupted serialization) */
+  void persist() {
+    if(!isFileBacked() || !loaded()) {
+      return;
+    }
+    if(!region->flush(0, 0, false)) {
+      throw std::runtime_error("failed to write back: " + filepath.string());
+    }
+    if(filepath != persistedFilepath) {
+      std::filesystem::rename(filepath, persistedFilepath); // (the mapping stays valid)
+      filepath = persistedFilepath;
+    }
+  }
+
+  /* publish this segment (e.g. the next generation of a dataset, built beside the current one)
+   * under the name of another one, atomically: new readers open this one, while the readers
+   * still mapping the replaced one keep it until they unmap it (the kernel reclaims it with its
+   * last mapping) */
+  void replace(std::string const& name) {
+    if(isFileBacked()) {
+      persist();
+      auto target = persistedFilepath.parent_path() / (name + ".wisent");
+      std::filesystem::rename(filepath, target);
+      filepath = persistedFilepath = target;
+      return;
+    }
+    std::string objectName = object.get_name(); // (the POSIX objects are files in /dev/shm)
+    std::filesystem::rename("/dev/shm/" + objectName.substr(objectName.front() == '/' ? 1 : 0),
+                            "/dev/shm/" + name);
+    object = shared_memory_object(open_only, name.c_str(), read_write);
+  }
+
   void free(void* pointer) {
     assert(pointer == baseAddress());
     unload();
@@ -47,17 +120,42 @@ public:
 
   void erase() {
     unload();
+    if(isFileBacked()) {
+      std::error_code error;
+      std::filesystem::remove(persistedFilepath.string() + ".partial", error);
+      std::filesystem::remove(persistedFilepath, error);
+      filepath = persistedFilepath;
+      return;
+    }
     shared_memory_object::remove(object.get_name());
   }
 
-  void load() { region = std::make_unique<mapped_region>(object, read_write); }
+  void load() {
+    auto mapOptions = mapping.populate ? MAP_POPULATE : default_map_options;
+    if(isFileBacked()) {
+      file_mapping file(filepath.c_str(), read_write);
+      region = std::make_unique<mapped_region>(file, read_write, 0, 0, nullptr, mapOptions);
+    } else {
+      region = std::make_unique<mapped_region>(object, read_write, 0, 0, nullptr, mapOptions);
+    }
+    if(mapping.transparentHugePages) {
+      madvise(region->get_address(), region->get_size(), MADV_HUGEPAGE); // (only a hint)
+    }
+  }
   void unload() { region.reset(); }
 
   bool exists() const {
-    offset_t size;
+    if(isFileBacked()) {
+      std::error_code error;
+      auto size = std::filesystem::file_size(filepath, error);
+      return !error && size > 0;
+    }
+    offset_t size = 0;
     return object.get_size(size) && size > 0;
   }
 
+  bool isFileBacked() const { return !persistedFilepath.empty(); }
+
   bool loaded() const {
     return exists() && region.get() != nullptr;
   }
@@ -71,12 +169,142 @@ public:
     assert(loaded());
     return region->get_size();
   }
+
+private:
+  void truncate(size_t size) {
+    if(isFileBacked()) {
+      if(hugePageSize > 0) {
+        size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+      }
+      std::filesystem::resize_file(filepath, size);
+      return;
+    }
+    object.truncate(size);
+  }
 };
 
-std::unordered_map<std::string, SharedMemorySegment>& sharedMemorySegments();
-SharedMemorySegment*& currentSharedMemory();
-void setCurrentSharedMemory(SharedMemorySegment& sharedMemory);
-void* sharedMemoryMalloc(size_t size);
-void* sharedMemoryRealloc(void* pointer, size_t size);
-void sharedMemoryFree(void* pointer);
+/* A large private address range reserved up front and only committed when touched
+ * (used as a staging area when the final size is not known in advance, and as the page-aligned
+ * memory of a tree written to a file) */
+class ReservedMemoryRange {
+private:
+  void* address;
+  size_t capacity;
+  size_t allocatedSize = 0;
+
+public:
+  explicit ReservedMemoryRange(size_t capacity)
+      : address(mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)),
+        capacity(capacity) {
+    if(address == MAP_FAILED) {
+      throw std::runtime_error("failed to reserve " + std::to_string(capacity) +
+                               " bytes of address space");
+    }
+  }
+  ~ReservedMemoryRange() { munmap(address, capacity); }
+
+  ReservedMemoryRange(ReservedMemoryRange const& other) = delete;
+  ReservedMemoryRange(ReservedMemoryRange&& other) = delete;
+  ReservedMemoryRange& operator=(ReservedMemoryRange const& other) = delete;
+  ReservedMemoryRange& operator=(ReservedMemoryRange&& other) = delete;
+
+  void* malloc(size_t size) {
+    checkCapacity(size);
+    allocatedSize = size;
+    return address;
+  }
+
+  void* realloc(void* pointer, size_t size) {
+    assert(pointer == address);
+    checkCapacity(size);
+    allocatedSize = size;
+    return address;
+  }
+
+  void* baseAddress() const { return address; }
+  size_t size() const { return allocatedSize; } // (as last allocated)
+  size_t reservedSize() const { return capacity; }
+
+private:
+  void checkCapacity(size_t size) const {
+    if(size > capacity) {
+      throw std::runtime_error("reserved memory range exhausted (" + std::to_string(size) + " > " +
+                               std::to_string(capacity) + " bytes)");
+    }
+  }
+};
+
+/* the registry of the process' segments (thread-safe): the references stay valid until the
+ * segment is erased from it, concurrent operations on the same segment hold its lock */
 SharedMemorySegment& createOrGetMemorySegment(std::string const& name);
+void eraseMemorySegment(std::string const& name); // (does not erase the segment's data)
+void freeMemorySegment(std::string const& name);  // erase its data and drop it from the registry
+/* replace the segment 'name' by the segment 'nextName' (see SharedMemorySegment::replace) */
+SharedMemorySegment& publishMemorySegment(std::string const& nextName, std::string const& name);
+/* a segment's lock, held until destroyed (the registry drops the locks no thread holds or waits
+ * for, so that they do not pile up with the names of erased segments) */
+class SegmentLock {
+public:
+  explicit SegmentLock(std::string name);
+  ~SegmentLock();
+  SegmentLock(SegmentLock const&) = delete;
+  SegmentLock& operator=(SegmentLock const&) = delete;
+
+private:
+  std::string name;
+};
+SegmentLock lockMemorySegment(std::string const& name);
+
+/**
+ * The current generation of a segment (mapped if needed), or if there is none or if rebuild is
+ * set, a new generation built beside it (build(segment) allocates and writes it) and published
+ * under the segment's name: its readers are neither interrupted nor blocked while it is rebuilt,
+ * and it is reclaimed once they all unmapped it. The builds of a segment run one at a time.
+ * Returns the base address.
+ */
+template <typename Build>
+void* loadOrBuildMemorySegment(std::string const& name, bool rebuild, Build&& build) {
+  auto current = [&name]() -> void* {
+    auto lock = lockMemorySegment(name);
+    auto& segment = createOrGetMemorySegment(name);
+    if(!segment.loaded() && segment.exists()) {
+      segment.load();
+    }
+    return segment.loaded() ? segment.baseAddress() : nullptr;
+  };
+  void* address = rebuild ? nullptr : current();
+  if(address != nullptr) {
+    return address;
+  }
+  auto nextName = name + ".next";
+  auto buildLock = lockMemorySegment(nextName);
+  address = rebuild ? nullptr : current(); // (built by a concurrent load meanwhile)
+  if(address != nullptr) {
+    return address;
+  }
+  freeMemorySegment(nextName); // (left by an interrupted build)
+  auto& next = createOrGetMemorySegment(nextName);
+  try {
+    build(next);
+  } catch(...) {
+    freeMemorySegment(nextName);
+    throw;
+  }
+  auto lock = lockMemorySegment(name);
+  return publishMemorySegment(nextName, name).baseAddress();
+}
+
+/* back the segments created from now on by files in this directory (empty: shared memory) */
+void setSegmentDirectory(std::string const& directory);
+std::string const& segmentDirectory();
+/* map the segments created from now on with these options */
+void setSegmentMapping(SegmentMapping const& mapping);
+SegmentMapping const& segmentMapping();
+/* a read-only descriptor of the segment's current data (-1 if there is none), e.g. passed to a
+ * process mapping it without opening the segment by name */
+int openMemorySegmentDescriptor(std::string const& name);
+/* the other processes mapping each segment's current data, in a single pass over
+ * /proc/[pid]/maps (the processes of other users are not counted) */
+std::unordered_map<std::string, size_t>
+countMemorySegmentMappings(std::vector<std::string> const& names);
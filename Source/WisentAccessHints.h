@@ -0,0 +1,52 @@
+#ifndef WISENTACCESSHINTS_H
+#define WISENTACCESSHINTS_H
+/* Hints about the upcoming access to the arguments of a tree, with madvise(): POSIX only
+ * (the tree's layout is in 'WisentHelpers.h') */
+#if !defined(__unix__) && !defined(__APPLE__)
+#error "WisentAccessHints.h needs POSIX madvise()"
+#endif
+#include "WisentHelpers.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(hicpp-use-auto,cppcoreguidelines-pro-type-union-access)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* madvise() the pages overlapping [begin, begin + size) */
+static int adviseBytes(void const* begin, size_t size, int advice) {
+  uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)begin & ~(pageSize - 1);
+  if(size == 0) {
+    return 0;
+  }
+  return madvise((void*)start, // NOLINT(performance-no-int-to-ptr)
+                 (uintptr_t)begin + size - start, advice);
+}
+
+/**
+ * Hint the kernel about the upcoming access to a range of arguments, e.g. a column about to be
+ * scanned (advice: MADV_SEQUENTIAL, MADV_WILLNEED, MADV_HUGEPAGE, ...): applies to their values,
+ * types and null bits. Returns -1 (and sets errno) if any of the madvise() calls failed.
+ */
+static int adviseArguments(struct WisentRootExpression* root, uint64_t start, uint64_t end,
+                           int advice) {
+  uint64_t typeSize = getArgumentTypeSize(getFormatVersion(root));
+  int result = adviseBytes(&getExpressionArguments(root)[start],
+                           (end - start) * sizeof(union WisentArgumentValue), advice);
+  result |= adviseBytes(getArgumentTypesBuffer(root) + start * typeSize,
+                        (end - start) * typeSize, advice);
+  if(getFormatFlags(root) & WISENT_FORMAT_FLAG_NULL_BITMAP) {
+    result |= adviseBytes(&getNullBitmap(root)[start / 64],
+                          ((end + 63) / 64 - start / 64) * sizeof(uint64_t), advice);
+  }
+  return result;
+}
+
+#ifdef __cplusplus
+}
+#endif
+// NOLINTEND(hicpp-use-auto,cppcoreguidelines-pro-type-union-access)
+
+#endif /* WISENTACCESSHINTS_H */
@@ -0,0 +1,117 @@
+#ifndef WISENTCATALOG_H
+#define WISENTCATALOG_H
+/* Waiting for the datasets of the server's catalog (and publishing them), on futexes: Linux only
+ * (the catalog's layout and readCatalogEntry() are in 'WisentHelpers.h') */
+#ifndef __linux__
+#error "WisentCatalog.h needs Linux futexes"
+#endif
+#include "WisentHelpers.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(hicpp-use-auto,cppcoreguidelines-pro-type-union-access)
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* sleep while *word == expected, until the deadline (CLOCK_MONOTONIC, NULL: none)
+ * returns false once the deadline passed */
+static bool waitForWordChange(uint32_t* word, uint32_t expected, struct timespec const* deadline) {
+  struct timespec now;
+  struct timespec timeout;
+  if(deadline == NULL) {
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+    return true;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  timeout.tv_sec = deadline->tv_sec - now.tv_sec;
+  timeout.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+  if(timeout.tv_nsec < 0) {
+    timeout.tv_nsec += 1000000000L;
+    --timeout.tv_sec;
+  }
+  if(timeout.tv_sec < 0) {
+    return false;
+  }
+  syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+  return true;
+}
+
+/**
+ * Wait until the dataset is loaded (WISENT_DATASET_READY) or failed (WISENT_DATASET_FAILED),
+ * sleeping on the catalog instead of polling the server; returns
+ * WISENT_DATASET_UNKNOWN/LOADING if the timeout (in milliseconds, negative: none) expires first.
+ */
+static uint32_t waitForDataset(struct WisentCatalog* catalog, char const* name,
+                               int64_t timeoutMilliseconds) {
+  struct timespec deadline;
+  struct WisentCatalogEntry* dataset;
+  uint32_t count;
+  uint32_t state;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeoutMilliseconds / 1000;
+  deadline.tv_nsec += (timeoutMilliseconds % 1000) * 1000000L;
+  if(deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_nsec -= 1000000000L;
+    ++deadline.tv_sec;
+  }
+  for(;;) {
+    count = __atomic_load_n(&catalog->count, __ATOMIC_ACQUIRE);
+    dataset = findCatalogEntry(catalog, name);
+    if(dataset == NULL) {
+      /* not requested yet: wait for a new entry */
+      if(!waitForWordChange(&catalog->count, count,
+                            timeoutMilliseconds < 0 ? NULL : &deadline)) {
+        return WISENT_DATASET_UNKNOWN;
+      }
+      continue;
+    }
+    state = __atomic_load_n(&dataset->state, __ATOMIC_ACQUIRE);
+    if(state == WISENT_DATASET_READY || state == WISENT_DATASET_FAILED) {
+      return state;
+    }
+    if(!waitForWordChange(&dataset->state, state, timeoutMilliseconds < 0 ? NULL : &deadline)) {
+      return state;
+    }
+  }
+}
+
+/* (server only, one thread at a time) publish a dataset's state and its description (NULL:
+ * unchanged), updating its entry atomically for the readers and waking its waiters
+ * returns false if there is no entry left for a new dataset */
+static bool publishCatalogEntry(struct WisentCatalog* catalog, char const* name, uint32_t state,
+                                struct WisentDatasetDescription const* description) {
+  struct WisentCatalogEntry* dataset = findCatalogEntry(catalog, name);
+  if(dataset == NULL) {
+    if(catalog->count == WISENT_CATALOG_MAX_DATASETS ||
+       strlen(name) >= WISENT_DATASET_NAME_SIZE) {
+      return false;
+    }
+    dataset = &catalog->datasets[catalog->count];
+    memset(dataset, 0, sizeof(struct WisentCatalogEntry));
+    strncpy(dataset->name, name, WISENT_DATASET_NAME_SIZE - 1);
+    __atomic_store_n(&catalog->count, catalog->count + 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &catalog->count, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+  }
+  __atomic_store_n(&dataset->sequence, dataset->sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  if(description != NULL) {
+    memcpy(&dataset->description, description, sizeof(struct WisentDatasetDescription));
+  }
+  if(state == WISENT_DATASET_READY) {
+    __atomic_store_n(&dataset->generation, dataset->generation + 1, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&dataset->state, state, __ATOMIC_RELAXED);
+  __atomic_store_n(&dataset->sequence, dataset->sequence + 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &dataset->state, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+  return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+// NOLINTEND(hicpp-use-auto,cppcoreguidelines-pro-type-union-access)
+
+#endif /* WISENTCATALOG_H */
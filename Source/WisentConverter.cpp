@@ -0,0 +1,185 @@
+#include "SharedMemorySegment.hpp"
+#include "WisentSerializer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* Offline conversion of JSON datasets (and their CSV files) into '.wisent' files, i.e. the bytes
+ * of the tree, as 'Example/example.wisent' and the segments of 'WisentServer --segment-dir'
+ * (which maps these files instead of serializing the datasets again: the default output
+ * directory with --segment-dir) */
+
+static size_t const reservedTreeSize = size_t{1} << 40; // (address space, committed when used)
+static size_t const reservedSizeLimit = size_t{64} << 40; // (of the 128 TB of user address space)
+static size_t const directIoAlignment = 4096;           // (the logical block size of the devices)
+static size_t const writeSize = size_t{64} << 20;       // bytes per write() call
+
+static std::runtime_error fileError(std::string const& what, std::string const& path) {
+  return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+/* write a tree into '<path>.partial' (with O_DIRECT unless buffered: the tree is written once,
+ * caching it would only evict other pages), sync it, then rename it to path
+ * (the tree's memory is page-aligned: O_DIRECT writes it without copying, the last block padded
+ * with the reserved bytes after it, then truncated) */
+static void writeTree(void const* tree, size_t size, size_t reservedSize, std::string const& path,
+                      bool buffered) {
+  auto partialPath = path + ".partial";
+  auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  auto fd = buffered ? -1 : open(partialPath.c_str(), flags | O_DIRECT, 0644);
+  auto direct = fd >= 0;
+  if(!direct) {
+    fd = open(partialPath.c_str(), flags, 0644); // (buffered, or O_DIRECT not supported: tmpfs)
+  }
+  if(fd < 0) {
+    throw fileError("failed to create", partialPath);
+  }
+  auto const* bytes = static_cast<char const*>(tree);
+  auto writtenSize = direct ? std::min(reservedSize, (size + directIoAlignment - 1) /
+                                                         directIoAlignment * directIoAlignment)
+                            : size;
+  for(size_t offset = 0; offset < writtenSize;) {
+    auto count = pwrite(fd, bytes + offset, std::min(writeSize, writtenSize - offset), offset);
+    if(count < 0 && errno == EINTR) {
+      continue;
+    }
+    if(count < 0 && errno == EINVAL && direct) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT); // (refused by the file system)
+      direct = false;
+      continue;
+    }
+    if(count <= 0) {
+      close(fd);
+      throw fileError("failed to write", partialPath);
+    }
+    offset += count;
+  }
+  if(ftruncate(fd, size) != 0 || fsync(fd) != 0) {
+    close(fd);
+    throw fileError("failed to write", partialPath);
+  }
+  close(fd);
+  std::filesystem::rename(partialPath, path);
+}
+
+static double megabytesPerSecond(uint64_t bytes, std::chrono::steady_clock::duration duration) {
+  auto seconds = std::chrono::duration<double>(duration).count();
+  return seconds > 0 ? bytes / 1e6 / seconds : 0;
+}
+
+int main(int argc, char** argv) {
+  wisent::serializer::LoadOptions options;
+  std::string outputDirectory;
+  unsigned threads = 0;
+  bool buffered = false;
+  std::vector<std::string> filepaths;
+  for(int i = 1; i < argc; ++i) {
+    if(std::string("--output-dir") == argv[i]) {
+      outputDirectory = argv[++i];
+      continue;
+    }
+    if(std::string("--threads") == argv[i]) {
+      threads = atoi(argv[++i]);
+      continue;
+    }
+    if(std::string("--buffered") == argv[i]) {
+      buffered = true;
+      continue;
+    }
+    if(wisent::serializer::parseLoadOption(argc, argv, i, options)) {
+      continue;
+    }
+    if(std::string("--segment-dir") == argv[i]) {
+      setSegmentDirectory(argv[++i]);
+      continue;
+    }
+    if(std::string("--transparent-huge-pages") == argv[i]) {
+      SegmentMapping mapping = segmentMapping();
+      mapping.transparentHugePages = true;
+      setSegmentMapping(mapping);
+      continue;
+    }
+    filepaths.emplace_back(argv[i]);
+  }
+  if(filepaths.empty()) {
+    std::cerr << "usage: " << argv[0] << " [options] [dataset.json]..." << std::endl;
+    return 2;
+  }
+
+  std::mutex outputMutex;
+  std::atomic<size_t> failures{0};
+  /* convert '[directory]/[name].json' into '[output directory or directory]/[name].wisent' */
+  auto convert = [&](std::string const& filepath) {
+    std::filesystem::path input(filepath);
+    auto directory = !outputDirectory.empty()     ? std::filesystem::path(outputDirectory)
+                     : !segmentDirectory().empty() ? std::filesystem::path(segmentDirectory())
+                                                   : input.parent_path();
+    auto outputPath = (directory / input.stem()).string() + ".wisent";
+    auto csvPrefix = filepath.substr(0, filepath.find_last_of("/\\") + 1);
+    auto fileOptions = options;
+    wisent::serializer::LoadProgress progress;
+    fileOptions.progress = &progress;
+    try {
+      auto start = std::chrono::steady_clock::now();
+      ReservedMemoryRange memory(reservedTreeSize);
+      if(segmentMapping().transparentHugePages) {
+        madvise(memory.baseAddress(), memory.reservedSize(), MADV_HUGEPAGE); // (only a hint)
+      }
+      auto* root = wisent::serializer::load(filepath, memory, csvPrefix, fileOptions);
+      auto serialized = std::chrono::steady_clock::now();
+      writeTree(root, memory.size(), memory.reservedSize(), outputPath, buffered);
+      auto written = std::chrono::steady_clock::now();
+      // (the progress counts the json document once per pass, a csv file when parsed and when
+      // converted)
+      auto jsonBytes = std::filesystem::file_size(filepath);
+      auto passes = fileOptions.singlePass ? 1 : 2;
+      auto inputBytes = jsonBytes + (progress.bytesProcessed - passes * jsonBytes) / 2;
+      std::lock_guard lock(outputMutex);
+      std::cout << filepath << " -> " << outputPath << ": " << inputBytes / 1e6 << " MB in, "
+                << memory.size() / 1e6 << " MB out, serialized at "
+                << megabytesPerSecond(inputBytes, serialized - start) << " MB/s, written at "
+                << megabytesPerSecond(memory.size(), written - serialized) << " MB/s ("
+                << megabytesPerSecond(inputBytes, written - start) << " MB/s overall)"
+                << std::endl;
+    } catch(std::exception const& e) {
+      ++failures;
+      std::lock_guard lock(outputMutex);
+      std::cerr << "failed to convert " << filepath << ": " << e.what() << std::endl;
+    }
+  };
+  // convert the files in parallel (each with its own memory and output file), as many as their
+  // reserved address space allows
+  if(threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  auto reservedSize = reservedTreeSize + wisent::serializer::getStagingReservation(options);
+  threads = std::max<size_t>(1, std::min<size_t>(threads, reservedSizeLimit / reservedSize));
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for(auto i = next++; i < filepaths.size(); i = next++) {
+      convert(filepaths[i]);
+    }
+  };
+  std::vector<std::thread> workers;
+  for(unsigned i = 1; i < std::min<size_t>(threads, filepaths.size()); ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for(auto& thread : workers) {
+    thread.join();
+  }
+  return failures > 0 ? 1 : 0;
+}
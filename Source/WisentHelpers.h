@@ -48,6 +48,108 @@ struct WisentExpression {
   uint64_t endChildOffset;
 };
 
+/* stored form of WisentExpression with WISENT_FORMAT_FLAG_COMPACT_OFFSETS */
+struct WisentCompactExpression {
+  uint32_t symbolNameOffset;
+  uint32_t startChildOffset;
+  uint32_t endChildOffset;
+};
+
+/* 8-byte argument types (RLE length in the next type), 64-bit expression offsets */
+static uint32_t const WISENT_FORMAT_VERSION_1 = 1;
+/* 1-byte argument types (RLE length in the next 4 types), padded to 8 bytes */
+static uint32_t const WISENT_FORMAT_VERSION_2 = 2;
+
+/* (version 2 only) expressions stored as WisentCompactExpression, for segments under 4 GB */
+static uint32_t const WISENT_FORMAT_FLAG_COMPACT_OFFSETS = 0x1;
+/* a bitmap after the types marks the missing/null arguments (set bit), which keep the type of
+ * their neighbours (and a zero value) so that they do not break the RLE runs */
+static uint32_t const WISENT_FORMAT_FLAG_NULL_BITMAP = 0x2;
+/* a chain of sections follows the string buffer (8-byte aligned), ended by WISENT_SECTION_END */
+static uint32_t const WISENT_FORMAT_FLAG_SECTIONS = 0x4;
+
+static uint32_t const WISENT_SECTION_END = 0;
+static uint32_t const WISENT_SECTION_ZONE_MAPS = 1;
+static uint32_t const WISENT_SECTION_KEY_INDEX = 2;
+static uint32_t const WISENT_SECTION_COLUMN_CAPACITIES = 3;
+
+struct WisentSectionHeader {
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t size; /* bytes following the header (multiple of 8) */
+};
+
+struct WisentBlockStats {
+  union WisentArgumentValue min; /* (min, max and sum are zero if count is zero) */
+  union WisentArgumentValue max;
+  /* a long sum out of the 64-bit range is saturated at INT64_MAX or INT64_MIN */
+  union WisentArgumentValue sum;
+  uint64_t count;     /* number of non-null values */
+  uint64_t nullCount; /* number of null or missing values */
+};
+
+struct WisentColumnStats {
+  uint64_t expressionIndex; /* the Table column's expression */
+  uint64_t type; /* ARGUMENT_TYPE_LONG or ARGUMENT_TYPE_DOUBLE (ARGUMENT_TYPE_STRING: no stats
+                  * since rows of another type were appended) */
+  uint64_t firstBlock;      /* index of the column's first block in the zone maps */
+  uint64_t blockCount;
+  struct WisentBlockStats total;
+};
+
+/**
+ * WISENT_SECTION_ZONE_MAPS: statistics of the numeric Table columns, for each block of blockSize
+ * rows (the last one can be smaller) and for the whole column. The blocks of all the columns
+ * follow the columns array (for a column with a capacity, followed by the unused blocks of its
+ * slack).
+ */
+struct WisentZoneMaps {
+  uint64_t blockSize;
+  uint64_t columnCount;
+  struct WisentColumnStats columns[];
+};
+
+struct WisentKeyIndexEntry {
+  uint64_t expressionIndex; /* the indexed expression */
+  uint64_t firstSlot;       /* index of the expression's first slot in the key index */
+  uint64_t slotCount;       /* (a power of two) */
+};
+
+/* empty slot of a key index hash table */
+static uint64_t const WISENT_KEY_INDEX_EMPTY_SLOT = UINT64_MAX;
+
+/**
+ * WISENT_SECTION_KEY_INDEX: open-addressing hash tables (linear probing, hashKey()) mapping the
+ * keys of the expressions with many keyed children (i.e. child expressions, named by their
+ * head) to the offset of the child argument from the expression's startChildOffset. The entries
+ * are sorted by expressionIndex and are followed by the slots of all the hash tables.
+ */
+struct WisentKeyIndex {
+  uint64_t entryCount;
+  struct WisentKeyIndexEntry entries[];
+};
+
+struct WisentColumnCapacity {
+  uint64_t expressionIndex; /* the Table column's expression */
+  uint64_t capacity;        /* argument slots reserved from its startChildOffset */
+  uint64_t csvColumn;       /* its column in the csv file (as projected by the load) */
+};
+
+/**
+ * WISENT_SECTION_COLUMN_CAPACITIES: the slack reserved after the arguments of the csv Table
+ * columns and at the end of the string buffer, for appending rows in place (the entries are
+ * sorted by expressionIndex). An append fills the slack, then publishes the columns' new
+ * endChildOffset with release stores: a reader loading it with an acquire load sees the rows
+ * up to it. The sequence is odd while an append updates the column ends and the zone maps, so
+ * that a reader needing both to be consistent retries while it is odd or changed.
+ */
+struct WisentColumnCapacities {
+  uint64_t columnCount;
+  uint64_t sequence;
+  uint64_t stringSlackStart; /* the string buffer is zero-filled from this offset to its end */
+  struct WisentColumnCapacity columns[];
+};
+
 /**
  * A single-allocation representation of an expression, including its arguments (i.e., a flattened
  * array of all arguments, another flattened array of argument types and an array of
@@ -56,7 +158,17 @@ struct WisentExpression {
 struct WisentRootExpression {
   uint64_t const argumentCount;
   uint64_t const expressionCount;
-  void* const originalAddress;
+  /**
+   * Format version 1 keeps the (aligned) address the tree was built at. From version 2, the word
+   * is tagged with WISENT_FORMAT_WORD_TAG and holds the layout of the buffers
+   * (WISENT_FORMAT_VERSION_*) and its optional features (WISENT_FORMAT_FLAG_*), see
+   * getFormatVersion() and getFormatFlags(). Always use the accessors below to read types and
+   * expressions.
+   */
+  union {
+    void* const originalAddress;
+    uint64_t const formatWord;
+  };
   /**
    * The index of the last used byte in the arguments buffer relative to the pointer returned by
    * getStringBuffer()
@@ -77,51 +189,205 @@ struct WisentRootExpression {
 //////////////////////////////// Part Extraction ///////////////////////////////
 
 struct WisentRootExpression* getDummySerializedExpression();
+/* set in the formatWord of a tree of format version 2 or later (never in an aligned address) */
+static uint64_t const WISENT_FORMAT_WORD_TAG = 0x1;
+
+static uint32_t getFormatVersion(struct WisentRootExpression const* root) {
+  if(!(root->formatWord & WISENT_FORMAT_WORD_TAG)) {
+    return WISENT_FORMAT_VERSION_1;
+  }
+  return (uint32_t)(root->formatWord & 0xffffffff) >> 1;
+}
+
+static uint32_t getFormatFlags(struct WisentRootExpression const* root) {
+  if(!(root->formatWord & WISENT_FORMAT_WORD_TAG)) {
+    return 0;
+  }
+  return (uint32_t)(root->formatWord >> 32);
+}
+
 static union WisentArgumentValue* getExpressionArguments(struct WisentRootExpression* root) {
   return (union WisentArgumentValue*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
       root->arguments;
 }
 
+static size_t getArgumentTypeSize(uint32_t formatVersion) {
+  return formatVersion >= WISENT_FORMAT_VERSION_2 ? 1 : sizeof(enum WisentArgumentType);
+}
+
+static size_t getArgumentTypesBufferSize(uint64_t argumentCount, uint32_t formatVersion) {
+  size_t const size = argumentCount * getArgumentTypeSize(formatVersion);
+  return (size + 7) & ~(size_t)7; // keep the expressions 8-byte aligned
+}
+
+static size_t getNullBitmapSize(uint64_t argumentCount, uint32_t formatFlags) {
+  if(!(formatFlags & WISENT_FORMAT_FLAG_NULL_BITMAP)) {
+    return 0;
+  }
+  return (argumentCount + 63) / 64 * sizeof(uint64_t);
+}
+
+static size_t getExpressionsBufferSize(uint64_t expressionCount, uint32_t formatFlags) {
+  return expressionCount * ((formatFlags & WISENT_FORMAT_FLAG_COMPACT_OFFSETS)
+                                ? sizeof(struct WisentCompactExpression)
+                                : sizeof(struct WisentExpression));
+}
+
+static char* getArgumentTypesBuffer(struct WisentRootExpression* root) {
+  return &root->arguments[root->argumentCount * sizeof(union WisentArgumentValue)];
+}
+
+/* (with WISENT_FORMAT_FLAG_NULL_BITMAP) bit i % 64 of word i / 64 is set if argument i is null */
+static uint64_t* getNullBitmap(struct WisentRootExpression* root) {
+  return (uint64_t*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      (getArgumentTypesBuffer(root) +
+       getArgumentTypesBufferSize(root->argumentCount, getFormatVersion(root)));
+}
+
+static char* getExpressionsBuffer(struct WisentRootExpression* root) {
+  return (char*)getNullBitmap(root) + // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+         getNullBitmapSize(root->argumentCount, getFormatFlags(root));
+}
+
+/* direct access to the types (format version 1 only, see getArgumentType() otherwise) */
 static enum WisentArgumentType* getArgumentTypes(struct WisentRootExpression* root) {
   return (enum WisentArgumentType*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      &root->arguments[root->argumentCount * sizeof(union WisentArgumentValue)];
+      getArgumentTypesBuffer(root);
 }
 
+/* direct access to the expressions (without compact offsets only, see getExpression() otherwise) */
 static struct WisentExpression* getExpressionSubexpressions(struct WisentRootExpression* root) {
   return (struct WisentExpression*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      &root->arguments[root->argumentCount *
-                       (sizeof(union WisentArgumentValue) + sizeof(enum WisentArgumentType))];
+      getExpressionsBuffer(root);
 }
 
 static char* getStringBuffer(struct WisentRootExpression* root) {
-  return (char*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      &root->arguments[root->argumentCount *
-                           (sizeof(union WisentArgumentValue) + sizeof(enum WisentArgumentType)) +
-                       root->expressionCount * (sizeof(struct WisentExpression))];
+  return getExpressionsBuffer(root) +
+         getExpressionsBufferSize(root->expressionCount, getFormatFlags(root));
+}
+
+///////////////////////////////// Format Accessors /////////////////////////////
+
+/* the type of an argument, including WisentArgumentType_RLE_BIT */
+static enum WisentArgumentType getArgumentType(struct WisentRootExpression* root,
+                                               uint64_t argumentI) {
+  if(getFormatVersion(root) >= WISENT_FORMAT_VERSION_2) {
+    return (enum WisentArgumentType)( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        (uint8_t)getArgumentTypesBuffer(root)[argumentI]);
+  }
+  return getArgumentTypes(root)[argumentI];
+}
+
+static void setArgumentType(struct WisentRootExpression* root, uint64_t argumentI,
+                            enum WisentArgumentType type) {
+  if(getFormatVersion(root) >= WISENT_FORMAT_VERSION_2) {
+    getArgumentTypesBuffer(root)[argumentI] = (char)type;
+    return;
+  }
+  getArgumentTypes(root)[argumentI] = type;
+}
+
+/* the length of the run starting at argumentI (if its type has WisentArgumentType_RLE_BIT) */
+static uint32_t getRLELength(struct WisentRootExpression* root, uint64_t argumentI) {
+  if(getFormatVersion(root) >= WISENT_FORMAT_VERSION_2) {
+    uint32_t length;
+    memcpy(&length, getArgumentTypesBuffer(root) + argumentI + 1, sizeof(length));
+    return length;
+  }
+  return (uint32_t)getArgumentTypes(root)[argumentI + 1];
+}
+
+static void setRLELength(struct WisentRootExpression* root, uint64_t argumentI, uint32_t length) {
+  if(getFormatVersion(root) >= WISENT_FORMAT_VERSION_2) {
+    memcpy(getArgumentTypesBuffer(root) + argumentI + 1, &length, sizeof(length));
+    return;
+  }
+  (*(size_t*)(&getArgumentTypes( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      root)[argumentI + 1])) = (size_t)length;
+}
+
+static struct WisentExpression getExpression(struct WisentRootExpression* root,
+                                             uint64_t expressionI) {
+  if(getFormatFlags(root) & WISENT_FORMAT_FLAG_COMPACT_OFFSETS) {
+    struct WisentCompactExpression const* compact =
+        (struct WisentCompactExpression*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        getExpressionsBuffer(root);
+    struct WisentExpression expression = {compact[expressionI].symbolNameOffset,
+                                          compact[expressionI].startChildOffset,
+                                          compact[expressionI].endChildOffset};
+    return expression;
+  }
+  return getExpressionSubexpressions(root)[expressionI];
+}
+
+static bool isArgumentNull(struct WisentRootExpression* root, uint64_t argumentI) {
+  return (getFormatFlags(root) & WISENT_FORMAT_FLAG_NULL_BITMAP) &&
+         ((getNullBitmap(root)[argumentI / 64] >> (argumentI % 64)) & 1);
+}
+
+/* (with WISENT_FORMAT_FLAG_NULL_BITMAP only) thread-safe for arguments sharing a bitmap word */
+static void setArgumentNull(struct WisentRootExpression* root, uint64_t argumentI) {
+  __atomic_fetch_or(&getNullBitmap(root)[argumentI / 64], (uint64_t)1 << (argumentI % 64),
+                    __ATOMIC_RELAXED);
+}
+
+/* with WISENT_FORMAT_FLAG_COMPACT_OFFSETS, the caller checks that the offsets fit in 32 bits */
+static void setExpression(struct WisentRootExpression* root, uint64_t expressionI,
+                          struct WisentExpression expression) {
+  if(getFormatFlags(root) & WISENT_FORMAT_FLAG_COMPACT_OFFSETS) {
+    struct WisentCompactExpression* compact =
+        (struct WisentCompactExpression*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        getExpressionsBuffer(root);
+    compact[expressionI].symbolNameOffset = (uint32_t)expression.symbolNameOffset;
+    compact[expressionI].startChildOffset = (uint32_t)expression.startChildOffset;
+    compact[expressionI].endChildOffset = (uint32_t)expression.endChildOffset;
+    return;
+  }
+  getExpressionSubexpressions(root)[expressionI] = expression;
 }
 
 //////////////////////////////   Memory Management /////////////////////////////
 
-static struct WisentRootExpression* allocateExpressionTree(uint64_t argumentCount,
-                                                           uint64_t expressionCount,
-                                                           void* (*allocateFunction)(size_t)) {
+static size_t getExpressionTreeSize(uint64_t argumentCount, uint64_t expressionCount,
+                                    uint32_t formatVersion, uint32_t formatFlags) {
+  return sizeof(struct WisentRootExpression) + sizeof(union WisentArgumentValue) * argumentCount +
+         getArgumentTypesBufferSize(argumentCount, formatVersion) +
+         getNullBitmapSize(argumentCount, formatFlags) +
+         getExpressionsBufferSize(expressionCount, formatFlags);
+}
+
+/* the memory of the null bitmap (WISENT_FORMAT_FLAG_NULL_BITMAP) must be zero-filled */
+static struct WisentRootExpression* initExpressionTree(void* memory, uint64_t argumentCount,
+                                                       uint64_t expressionCount,
+                                                       uint32_t formatVersion,
+                                                       uint32_t formatFlags) {
   struct WisentRootExpression* root =
-      (struct WisentRootExpression*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      allocateFunction(              // NOLINT(hicpp-no-malloc,cppcoreguidelines-no-malloc)
-          sizeof(struct WisentRootExpression) + sizeof(union WisentArgumentValue) * argumentCount +
-          sizeof(enum WisentArgumentType) * argumentCount +
-          sizeof(struct WisentExpression) * expressionCount);
+      (struct WisentRootExpression*)memory; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
   *((uint64_t*)&root->argumentCount) = // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
       argumentCount;
   *((uint64_t*)&root->expressionCount) = // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
       expressionCount;
   *((uint64_t*)&root->stringArgumentsFillIndex) = // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
       0;
-  *((void**)&root->originalAddress) = // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      root;
+  if(formatVersion < WISENT_FORMAT_VERSION_2) {
+    *((void**)&root->originalAddress) = // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        root;
+  } else {
+    *((uint64_t*)&root->formatWord) = // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        WISENT_FORMAT_WORD_TAG | (uint64_t)formatVersion << 1 | (uint64_t)formatFlags << 32;
+  }
   return root;
 }
 
+static struct WisentRootExpression* allocateExpressionTree(uint64_t argumentCount,
+                                                           uint64_t expressionCount,
+                                                           void* (*allocateFunction)(size_t)) {
+  return initExpressionTree(
+      allocateFunction( // NOLINT(hicpp-no-malloc,cppcoreguidelines-no-malloc)
+          getExpressionTreeSize(argumentCount, expressionCount, WISENT_FORMAT_VERSION_1, 0)),
+      argumentCount, expressionCount, WISENT_FORMAT_VERSION_1, 0);
+}
+
 static void freeExpressionTree(struct WisentRootExpression* root, void (*freeFunction)(void*)) {
   freeFunction(root); // NOLINT(cppcoreguidelines-no-malloc,hicpp-no-malloc)
 }
@@ -131,7 +397,7 @@ static int64_t* makeLongArgument(struct WisentRootExpression* root, uint64_t arg
   auto ARGUMENT_TYPE_LONG = WisentArgumentType::ARGUMENT_TYPE_LONG;
 #endif
 
-  getArgumentTypes(root)[argumentOutputI] = ARGUMENT_TYPE_LONG;
+  setArgumentType(root, argumentOutputI, ARGUMENT_TYPE_LONG);
   return &getExpressionArguments(root)[argumentOutputI].asLong;
 };
 
@@ -139,7 +405,7 @@ static size_t* makeSymbolArgument(struct WisentRootExpression* root, uint64_t ar
 #ifdef __cplusplus
   auto ARGUMENT_TYPE_SYMBOL = WisentArgumentType::ARGUMENT_TYPE_SYMBOL;
 #endif
-  getArgumentTypes(root)[argumentOutputI] = ARGUMENT_TYPE_SYMBOL;
+  setArgumentType(root, argumentOutputI, ARGUMENT_TYPE_SYMBOL);
   return &getExpressionArguments(root)[argumentOutputI].asString;
 };
 
@@ -147,7 +413,7 @@ static size_t* makeExpressionArgument(struct WisentRootExpression* root, uint64_
 #ifdef __cplusplus
   auto ARGUMENT_TYPE_SYMBOL = WisentArgumentType::ARGUMENT_TYPE_EXPRESSION;
 #endif
-  getArgumentTypes(root)[argumentOutputI] = ARGUMENT_TYPE_EXPRESSION;
+  setArgumentType(root, argumentOutputI, ARGUMENT_TYPE_EXPRESSION);
   return &getExpressionArguments(root)[argumentOutputI].asString;
 };
 
@@ -155,15 +421,24 @@ static size_t* makeStringArgument(struct WisentRootExpression* root, uint64_t ar
 #ifdef __cplusplus
   auto ARGUMENT_TYPE_STRING = WisentArgumentType::ARGUMENT_TYPE_STRING;
 #endif
-  getArgumentTypes(root)[argumentOutputI] = ARGUMENT_TYPE_STRING;
+  setArgumentType(root, argumentOutputI, ARGUMENT_TYPE_STRING);
   return &getExpressionArguments(root)[argumentOutputI].asString;
 };
 
+static bool* makeBoolArgument(struct WisentRootExpression* root, uint64_t argumentOutputI) {
+#ifdef __cplusplus
+  auto ARGUMENT_TYPE_BOOL = WisentArgumentType::ARGUMENT_TYPE_BOOL;
+#endif
+  setArgumentType(root, argumentOutputI, ARGUMENT_TYPE_BOOL);
+  getExpressionArguments(root)[argumentOutputI].asLong = 0; // clear the unused bytes
+  return &getExpressionArguments(root)[argumentOutputI].asBool;
+};
+
 static double* makeDoubleArgument(struct WisentRootExpression* root, uint64_t argumentOutputI) {
 #ifdef __cplusplus
   auto ARGUMENT_TYPE_DOUBLE = WisentArgumentType::ARGUMENT_TYPE_DOUBLE;
 #endif
-  getArgumentTypes(root)[argumentOutputI] = ARGUMENT_TYPE_DOUBLE;
+  setArgumentType(root, argumentOutputI, ARGUMENT_TYPE_DOUBLE);
   return &getExpressionArguments(root)[argumentOutputI].asDouble;
 };
 
@@ -171,16 +446,16 @@ static void setRLEArgumentFlagOrPropagateTypes(struct WisentRootExpression* root
                                                uint64_t argumentOutputI, uint32_t size) {
   if(size < WisentArgumentType_RLE_MINIMUM_SIZE) {
     // RLE is not supported, fallback to set the argument types
-    enum WisentArgumentType const type = getArgumentTypes(root)[argumentOutputI];
+    enum WisentArgumentType const type = getArgumentType(root, argumentOutputI);
     for(uint64_t i = argumentOutputI + 1; i < argumentOutputI + size; ++i) {
-      getArgumentTypes(root)[i] = type;
+      setArgumentType(root, i, type);
     }
     return;
   }
-  (*(size_t*)(&getArgumentTypes( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      root)[argumentOutputI])) |= WisentArgumentType_RLE_BIT;
-  (*(size_t*)(&getArgumentTypes( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      root)[argumentOutputI + 1])) = (size_t)size;
+  setArgumentType(root, argumentOutputI,
+                  (enum WisentArgumentType)( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+                      getArgumentType(root, argumentOutputI) | WisentArgumentType_RLE_BIT));
+  setRLELength(root, argumentOutputI, size);
 }
 
 static int64_t* makeLongArgumentsRun(struct WisentRootExpression* root, uint64_t argumentOutputI,
@@ -218,6 +493,7 @@ static double* makeDoubleArgumentsRun(struct WisentRootExpression* root, uint64_
   return value;
 }
 
+/* (without compact offsets only, see setExpression() otherwise) */
 static struct WisentExpression* makeExpression(struct WisentRootExpression* root,
                                                uint64_t expressionOutputI) {
   return &getExpressionSubexpressions(root)[expressionOutputI];
@@ -238,10 +514,509 @@ static size_t storeString(struct WisentRootExpression** root, char const* inputS
   return result - getStringBuffer(*root);
 };
 
+static size_t getStringBufferOffset(struct WisentRootExpression* root) {
+  return (size_t)(getStringBuffer(root) - // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+                  (char*)root);           // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+}
+
+/**
+ * Same as storeString() but without any reallocation: the caller is responsible for reserving
+ * enough space after the string buffer (e.g. growing it geometrically instead of once per string)
+ */
+static size_t storeStringInPlace(struct WisentRootExpression* root, char const* inputString,
+                                 size_t inputStringLength) {
+  size_t const offset = root->stringArgumentsFillIndex;
+  memcpy(getStringBuffer(root) + offset, inputString, inputStringLength);
+  getStringBuffer(root)[offset + inputStringLength] = '\0';
+  root->stringArgumentsFillIndex += inputStringLength + 1;
+  return offset;
+};
+
 static char const* viewString(struct WisentRootExpression* root, size_t inputStringOffset) {
   return getStringBuffer(root) + inputStringOffset;
 };
 
+////////////////////////////////// Sections ////////////////////////////////////
+
+/* offset of the first section relative to the root (WISENT_FORMAT_FLAG_SECTIONS) */
+static size_t getSectionsOffset(struct WisentRootExpression* root) {
+  return (getStringBufferOffset(root) + root->stringArgumentsFillIndex + 7) & ~(size_t)7;
+}
+
+/* the content of the first section of this kind, NULL if there is none */
+static void* findSection(struct WisentRootExpression* root, uint32_t kind) {
+  struct WisentSectionHeader* section;
+  if(!(getFormatFlags(root) & WISENT_FORMAT_FLAG_SECTIONS)) {
+    return NULL;
+  }
+  section = (struct WisentSectionHeader*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      ((char*)root + getSectionsOffset(root)); // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  for(; section->kind != WISENT_SECTION_END;
+      section = (struct WisentSectionHeader*)( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+          (char*)(section + 1) + section->size)) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+    if(section->kind == kind) {
+      return section + 1;
+    }
+  }
+  return NULL;
+}
+
+static struct WisentZoneMaps* getZoneMaps(struct WisentRootExpression* root) {
+  return (struct WisentZoneMaps*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      findSection(root, WISENT_SECTION_ZONE_MAPS);
+}
+
+/* the statistics of a Table column, NULL if it has none (e.g. not numeric) */
+static struct WisentColumnStats* getColumnStats(struct WisentRootExpression* root,
+                                                uint64_t columnExpressionIndex) {
+  struct WisentZoneMaps* zoneMaps = getZoneMaps(root);
+  uint64_t i;
+  if(zoneMaps == NULL) {
+    return NULL;
+  }
+  for(i = 0; i < zoneMaps->columnCount; ++i) {
+    if(zoneMaps->columns[i].expressionIndex == columnExpressionIndex) {
+      return &zoneMaps->columns[i];
+    }
+  }
+  return NULL;
+}
+
+/* the blockCount blocks of a column returned by getColumnStats() */
+static struct WisentBlockStats* getBlockStats(struct WisentRootExpression* root,
+                                              struct WisentColumnStats const* column) {
+  struct WisentZoneMaps* zoneMaps = getZoneMaps(root);
+  return (struct WisentBlockStats*)&zoneMaps // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+             ->columns[zoneMaps->columnCount] +
+         column->firstBlock;
+}
+
+/* the capacity of a Table column, NULL if it has no slack recorded */
+static struct WisentColumnCapacity* getColumnCapacity(struct WisentRootExpression* root,
+                                                      uint64_t columnExpressionIndex) {
+  struct WisentColumnCapacities* capacities =
+      (struct WisentColumnCapacities*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      findSection(root, WISENT_SECTION_COLUMN_CAPACITIES);
+  uint64_t low = 0;
+  uint64_t high;
+  if(capacities == NULL) {
+    return NULL;
+  }
+  high = capacities->columnCount;
+  while(low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if(capacities->columns[middle].expressionIndex < columnExpressionIndex) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if(low == capacities->columnCount ||
+     capacities->columns[low].expressionIndex != columnExpressionIndex) {
+    return NULL;
+  }
+  return &capacities->columns[low];
+}
+
+/* FNV-1a hash of the keys in the key index */
+static uint64_t hashKey(char const* key, size_t keyLength) {
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+  for(i = 0; i < keyLength; ++i) {
+    hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* the end of the run of arguments (RLE or single) starting at argumentI */
+static uint64_t getArgumentRunEnd(struct WisentRootExpression* root, uint64_t argumentI) {
+  if(getArgumentType(root, argumentI) & WisentArgumentType_RLE_BIT) {
+    return argumentI + getRLELength(root, argumentI);
+  }
+  return argumentI + 1;
+}
+
+/* the key index of an expression, NULL if it is not indexed */
+static struct WisentKeyIndexEntry* getKeyIndexEntry(struct WisentRootExpression* root,
+                                                    uint64_t expressionIndex) {
+  struct WisentKeyIndex* keyIndex =
+      (struct WisentKeyIndex*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      findSection(root, WISENT_SECTION_KEY_INDEX);
+  uint64_t low = 0;
+  uint64_t high;
+  if(keyIndex == NULL) {
+    return NULL;
+  }
+  high = keyIndex->entryCount;
+  while(low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if(keyIndex->entries[middle].expressionIndex < expressionIndex) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if(low == keyIndex->entryCount || keyIndex->entries[low].expressionIndex != expressionIndex) {
+    return NULL;
+  }
+  return &keyIndex->entries[low];
+}
+
+/* the argument index of the first child expression with this head, UINT64_MAX if none */
+static uint64_t findKeyArgument(struct WisentRootExpression* root,
+                                struct WisentKeyIndexEntry const* entry, char const* key,
+                                size_t keyLength) {
+  struct WisentKeyIndex* keyIndex =
+      (struct WisentKeyIndex*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      findSection(root, WISENT_SECTION_KEY_INDEX);
+  uint64_t const* slots = (uint64_t const*) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+                              &keyIndex->entries[keyIndex->entryCount] +
+                          entry->firstSlot;
+  uint64_t startChildOffset = getExpression(root, entry->expressionIndex).startChildOffset;
+  uint64_t mask = entry->slotCount - 1;
+  uint64_t slot;
+  for(slot = hashKey(key, keyLength) & mask; slots[slot] != WISENT_KEY_INDEX_EMPTY_SLOT;
+      slot = (slot + 1) & mask) {
+    uint64_t argumentIndex = startChildOffset + slots[slot];
+    char const* childKey = viewString(
+        root,
+        getExpression(root, getExpressionArguments(root)[argumentIndex].asExpression)
+            .symbolNameOffset);
+    if(strncmp(childKey, key, keyLength) == 0 && childKey[keyLength] == '\0') {
+      return argumentIndex;
+    }
+  }
+  return UINT64_MAX;
+}
+
+/////////////////////////////////// Arenas ////////////////////////////////////
+
+/* "WSNTARNA": the start of a segment holding an arena of named allocations (see SegmentArena) */
+#define WISENT_ARENA_MAGIC 0x414e5241544e5357ULL
+#define WISENT_ARENA_MAX_ENTRIES 255
+#define WISENT_ARENA_ENTRY_NAME_SIZE 48
+
+struct WisentArenaEntry {
+  char name[WISENT_ARENA_ENTRY_NAME_SIZE]; /* nul-terminated */
+  uint64_t offset;                        /* from the segment's start */
+  uint64_t size;
+  uint64_t readerSlot; /* its count in WisentArenaHeader::readers (kept while it exists) */
+};
+
+/* the arena's header at the segment's start, followed by the allocations */
+struct WisentArenaHeader {
+  uint64_t magic;
+  uint64_t size; /* end of the last allocation */
+  uint64_t entryCount;
+  uint64_t sequence; /* odd while the server updates the entries (see findArenaEntry) */
+  struct WisentArenaEntry entries[WISENT_ARENA_MAX_ENTRIES]; /* sorted by offset */
+  uint64_t readers[WISENT_ARENA_MAX_ENTRIES]; /* per slot (see acquireArenaEntry) */
+};
+
+/* the named allocation (e.g. a tree's root) in a mapped arena segment, NULL if none
+ * (retrying while the server updates the entries; an allocation can move when it grows: look it
+ * up again after remapping the segment) */
+static void* findArenaEntry(void* segment, char const* name) {
+  struct WisentArenaHeader* header =
+      (struct WisentArenaHeader*)segment; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  uint64_t sequence;
+  uint64_t count;
+  uint64_t offset;
+  uint64_t i;
+  if(header->magic != WISENT_ARENA_MAGIC) {
+    return NULL;
+  }
+  for(;;) {
+    sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+    if(sequence & 1U) {
+      continue;
+    }
+    count = header->entryCount;
+    offset = 0; /* (the allocations start after the header) */
+    for(i = 0; i < count && i < WISENT_ARENA_MAX_ENTRIES; ++i) {
+      if(strncmp(header->entries[i].name, name, WISENT_ARENA_ENTRY_NAME_SIZE) == 0) {
+        offset = header->entries[i].offset;
+        break;
+      }
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) == sequence) {
+      if(offset == 0) {
+        return NULL;
+      }
+      return (char*)segment + offset; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+    }
+  }
+}
+
+/* as findArenaEntry(), counting the caller as a reader of the allocation until
+ * releaseArenaEntry(*readerSlot): the server neither frees nor reuses an allocation while it has
+ * readers (e.g. the tree replaced by a reload, rejected meanwhile) */
+static void* acquireArenaEntry(void* segment, char const* name, uint64_t* readerSlot) {
+  struct WisentArenaHeader* header =
+      (struct WisentArenaHeader*)segment; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  uint64_t sequence;
+  uint64_t count;
+  uint64_t offset;
+  uint64_t slot;
+  uint64_t i;
+  if(header->magic != WISENT_ARENA_MAGIC) {
+    return NULL;
+  }
+  for(;;) {
+    sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+    if(sequence & 1U) {
+      continue;
+    }
+    count = header->entryCount;
+    offset = 0;
+    slot = 0;
+    for(i = 0; i < count && i < WISENT_ARENA_MAX_ENTRIES; ++i) {
+      if(strncmp(header->entries[i].name, name, WISENT_ARENA_ENTRY_NAME_SIZE) == 0) {
+        offset = header->entries[i].offset;
+        slot = header->entries[i].readerSlot;
+        break;
+      }
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) != sequence) {
+      continue;
+    }
+    if(offset == 0 || slot >= WISENT_ARENA_MAX_ENTRIES) {
+      return NULL;
+    }
+    /* counted, then checked again: the server checks the count after changing the sequence */
+    __atomic_fetch_add(&header->readers[slot], 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&header->sequence, __ATOMIC_SEQ_CST) == sequence) {
+      *readerSlot = slot;
+      return (char*)segment + offset; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+    }
+    __atomic_fetch_sub(&header->readers[slot], 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void releaseArenaEntry(void* segment, uint64_t readerSlot) {
+  struct WisentArenaHeader* header =
+      (struct WisentArenaHeader*)segment; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  __atomic_fetch_sub(&header->readers[readerSlot], 1, __ATOMIC_RELEASE);
+}
+
+/////////////////////////////// Dataset Catalog //////////////////////////////
+
+/* "WSNTCTLG": the start of the server's catalog segment, listing its datasets so that the readers
+ * find and attach to them without a request (and wait for their loads) */
+#define WISENT_CATALOG_MAGIC 0x474c5443544e5357ULL
+#define WISENT_CATALOG_SEGMENT "wisent_catalog"
+#define WISENT_CATALOG_MAX_DATASETS 255
+#define WISENT_DATASET_NAME_SIZE 48
+
+/* the state of a dataset (a futex word: waiters sleep until it changes) */
+#define WISENT_DATASET_UNKNOWN 0
+#define WISENT_DATASET_LOADING 1
+#define WISENT_DATASET_READY 2
+#define WISENT_DATASET_FAILED 3
+
+/* how a dataset is serialized */
+#define WISENT_DATASET_KIND_WISENT 1
+#define WISENT_DATASET_KIND_JSON 2
+#define WISENT_DATASET_KIND_BSON 3
+
+/* where a loaded dataset is and what it holds (the schema summary of Wisent trees only) */
+struct WisentDatasetDescription {
+  char segmentName[WISENT_DATASET_NAME_SIZE]; /* the segment holding it (maybe an arena) */
+  uint64_t offset;                             /* of its tree in the segment (0 but in an arena) */
+  uint64_t size;                               /* in bytes */
+  int64_t loadedAt;                            /* end of the load (unix time, in nanoseconds) */
+  uint64_t loadNanoseconds;
+  uint32_t kind;
+  uint32_t formatVersion;
+  uint32_t formatFlags;
+  uint32_t tableCount;
+  uint64_t columnCount; /* of all the tables (but the placeholders of a column projection) */
+  uint64_t rowCount;    /* of all the tables */
+  uint64_t argumentCount;
+  uint64_t expressionCount;
+};
+
+struct WisentCatalogEntry {
+  char name[WISENT_DATASET_NAME_SIZE]; /* nul-terminated */
+  uint32_t state;
+  uint32_t generation; /* incremented by each load publishing it (readers remap if it changed) */
+  uint32_t sequence;   /* odd while the server updates the entry (see readCatalogEntry) */
+  uint32_t reserved;
+  struct WisentDatasetDescription description;
+};
+
+/* written by the server only: the entries are added (count is a futex word too), never removed */
+struct WisentCatalog {
+  uint64_t magic;
+  uint32_t count;
+  uint32_t reserved;
+  struct WisentCatalogEntry datasets[WISENT_CATALOG_MAX_DATASETS];
+};
+
+static struct WisentCatalogEntry* findCatalogEntry(struct WisentCatalog* catalog,
+                                                   char const* name) {
+  uint32_t count = __atomic_load_n(&catalog->count, __ATOMIC_ACQUIRE);
+  uint32_t i;
+  for(i = 0; i < count; ++i) {
+    if(strncmp(catalog->datasets[i].name, name, WISENT_DATASET_NAME_SIZE) == 0) {
+      return &catalog->datasets[i];
+    }
+  }
+  return NULL;
+}
+
+/* copy a consistent snapshot of the dataset's entry (retrying while the server updates it)
+ * returns false if the catalog does not list the dataset */
+static bool readCatalogEntry(struct WisentCatalog* catalog, char const* name,
+                             struct WisentCatalogEntry* copy) {
+  struct WisentCatalogEntry* entry = findCatalogEntry(catalog, name);
+  uint32_t sequence;
+  if(entry == NULL) {
+    return false;
+  }
+  for(;;) {
+    sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+    if(sequence & 1U) {
+      continue;
+    }
+    memcpy(copy, entry, sizeof(struct WisentCatalogEntry));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED) == sequence) {
+      return true;
+    }
+  }
+}
+
+/* the columns and rows of a csv Table expression: the columns with rows (not the empty
+ * placeholders of a column projection, unless the table has no rows at all) */
+static void describeTable(struct WisentRootExpression* root, struct WisentExpression table,
+                          uint64_t* columnCount, uint64_t* rowCount) {
+  struct WisentExpression column;
+  uint64_t runEnd;
+  uint64_t rows;
+  uint64_t columns = 0;
+  uint64_t filledColumns = 0;
+  uint64_t i;
+  uint64_t j;
+  *rowCount = 0;
+  for(i = table.startChildOffset; i < table.endChildOffset; i = runEnd) {
+    runEnd = getArgumentRunEnd(root, i);
+    if((getArgumentType(root, i) & ~WisentArgumentType_RLE_BIT) != ARGUMENT_TYPE_EXPRESSION) {
+      continue;
+    }
+    for(j = i; j < runEnd && j < table.endChildOffset; ++j) {
+      column = getExpression(root, getExpressionArguments(root)[j].asExpression);
+      rows = column.endChildOffset - column.startChildOffset;
+      ++columns;
+      if(rows > 0) {
+        ++filledColumns;
+        *rowCount = *rowCount == 0 ? rows : *rowCount;
+      }
+    }
+  }
+  *columnCount = filledColumns > 0 ? filledColumns : columns;
+}
+
+/* the csv tables of a Wisent tree: the expressions with the head "Table" (but the keys of json
+ * objects named "Table", marked first), their columns and rows */
+static void describeExpressionTree(struct WisentRootExpression* root,
+                                   struct WisentDatasetDescription* description) {
+  struct WisentExpression expression;
+  uint64_t* keys; /* a bit per expression: a key of an object */
+  uint64_t index;
+  uint64_t columns;
+  uint64_t rows;
+  uint64_t runEnd;
+  uint64_t i;
+  uint64_t j;
+  description->formatVersion = getFormatVersion(root);
+  description->formatFlags = getFormatFlags(root);
+  description->argumentCount = root->argumentCount;
+  description->expressionCount = root->expressionCount;
+  description->tableCount = 0;
+  description->columnCount = 0;
+  description->rowCount = 0;
+  keys = (uint64_t*)calloc( // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      (root->expressionCount + 63) / 64 + 1, sizeof(uint64_t));
+  if(keys == NULL) {
+    return;
+  }
+  for(i = 0; i < root->expressionCount; ++i) {
+    expression = getExpression(root, i);
+    if(strcmp(viewString(root, expression.symbolNameOffset), "Object") != 0) {
+      continue;
+    }
+    for(j = expression.startChildOffset; j < expression.endChildOffset; j = runEnd) {
+      runEnd = getArgumentRunEnd(root, j);
+      if((getArgumentType(root, j) & ~WisentArgumentType_RLE_BIT) != ARGUMENT_TYPE_EXPRESSION) {
+        continue;
+      }
+      for(; j < runEnd && j < expression.endChildOffset; ++j) {
+        index = getExpressionArguments(root)[j].asExpression;
+        keys[index / 64] |= (uint64_t)1 << (index % 64);
+      }
+    }
+  }
+  for(i = 0; i < root->expressionCount; ++i) {
+    expression = getExpression(root, i);
+    if(((keys[i / 64] >> (i % 64)) & 1U) == 0 &&
+       strcmp(viewString(root, expression.symbolNameOffset), "Table") == 0) {
+      describeTable(root, expression, &columns, &rows);
+      ++description->tableCount;
+      description->columnCount += columns;
+      description->rowCount += rows;
+    }
+  }
+  free(keys);
+}
+
+/////////////////////////////// Control Channel //////////////////////////////
+
+/* "WSNTCMDS": the start of a batch of commands sent to the server's control socket (see
+ * --control-socket), and of the batch of replies (one per command, in order) it responds with:
+ * struct WisentControlBatch, then per command struct WisentControlCommand and its path, or per
+ * reply struct WisentControlReply and its error message; the replies' descriptors are passed
+ * with the replies (SCM_RIGHTS), in order */
+#define WISENT_CONTROL_MAGIC 0x53444d43544e5357ULL
+#define WISENT_CONTROL_MAX_COMMANDS 253 /* (the most descriptors passed in a message) */
+
+#define WISENT_CONTROL_LOAD 1
+#define WISENT_CONTROL_UNLOAD 2
+#define WISENT_CONTROL_ERASE 3
+#define WISENT_CONTROL_ATTACH 4 /* (a loaded dataset: only passes its descriptor) */
+#define WISENT_CONTROL_STOP 5
+
+#define WISENT_CONTROL_TO_JSON 0x1
+#define WISENT_CONTROL_TO_BSON 0x2
+#define WISENT_CONTROL_SKIP_CSV 0x4
+#define WISENT_CONTROL_RELOAD 0x8
+#define WISENT_CONTROL_PASS_DESCRIPTOR 0x10 /* reply with a read-only descriptor of its segment */
+
+struct WisentControlBatch {
+  uint64_t magic;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct WisentControlCommand {
+  char name[WISENT_DATASET_NAME_SIZE]; /* nul-terminated */
+  uint32_t command;
+  uint32_t flags;
+  uint32_t pathSize; /* the path follows (not nul-terminated) */
+  uint32_t reserved;
+};
+
+struct WisentControlReply {
+  uint32_t status;    /* 0: done */
+  uint32_t errorSize; /* the error message follows (not nul-terminated) */
+  uint32_t hasDescriptor;
+  uint32_t reserved;
+  uint64_t offset; /* of the dataset's tree in the segment (see WisentDatasetDescription) */
+  uint64_t size;
+};
+
 #ifdef __cplusplus
 }
 #endif
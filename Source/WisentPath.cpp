@@ -0,0 +1,174 @@
+#include "WisentPath.hpp"
+#include <stdexcept>
+#include <string_view>
+
+using wisent::path::CompiledPath;
+
+namespace {
+struct Argument {
+  uint64_t index;
+  WisentArgumentType type;
+};
+
+/* call func(runStart, runEnd, type) for each run of child arguments until it returns false
+ * (the types inside a run are not readable, e.g. they hold the RLE length) */
+template <typename Func>
+void forEachRun(WisentRootExpression* root, WisentExpression const& expression, Func&& func) {
+  for(auto runStart = expression.startChildOffset; runStart < expression.endChildOffset;) {
+    auto runEnd = getArgumentRunEnd(root, runStart);
+    auto type = static_cast<WisentArgumentType>(getArgumentType(root, runStart) &
+                                                ~WisentArgumentType_RLE_BIT);
+    if(!func(runStart, runEnd, type)) {
+      return;
+    }
+    runStart = runEnd;
+  }
+}
+
+std::string_view getHead(WisentRootExpression* root, uint64_t argIndex) {
+  auto expressionIndex = getExpressionArguments(root)[argIndex].asExpression;
+  return viewString(root, getExpression(root, expressionIndex).symbolNameOffset);
+}
+} // namespace
+
+CompiledPath::CompiledPath(std::string const& path) : path(path) {
+  auto invalid = [&path](std::string const& reason) {
+    return std::runtime_error("invalid path '" + path + "': " + reason);
+  };
+  size_t pos = 0;
+  auto parseName = [&]() {
+    auto end = path.find_first_of(".[]", pos);
+    end = end == std::string::npos ? path.size() : end;
+    if(end == pos) {
+      throw invalid("empty key at " + std::to_string(pos));
+    }
+    steps.push_back({Step::Kind::Key, path.substr(pos, end - pos), 0});
+    pos = end;
+  };
+  while(pos < path.size()) {
+    if(path[pos] == '.') {
+      ++pos;
+      parseName();
+      continue;
+    }
+    if(path[pos] != '[') {
+      if(pos > 0) {
+        throw invalid("expected '.' or '[' at " + std::to_string(pos));
+      }
+      parseName();
+      continue;
+    }
+    auto close = path.find(']', ++pos);
+    if(close == std::string::npos) {
+      throw invalid("missing ']'");
+    }
+    auto content = path.substr(pos, close - pos);
+    if(content == "*") {
+      steps.push_back({Step::Kind::Wildcard, {}, 0});
+    } else if(content.size() >= 2 && (content.front() == '"' || content.front() == '\'')) {
+      // quoted key (for keys with '.', '[' or ']'): find the closing quote, then the ']'
+      auto closeQuote = path.find(content.front(), pos + 1);
+      if(closeQuote == std::string::npos || closeQuote + 1 >= path.size() ||
+         path[closeQuote + 1] != ']') {
+        throw invalid("unterminated quoted key at " + std::to_string(pos));
+      }
+      close = closeQuote + 1;
+      steps.push_back({Step::Kind::Key, path.substr(pos + 1, closeQuote - pos - 1), 0});
+    } else if(!content.empty() && content.find_first_not_of("0123456789") == std::string::npos) {
+      steps.push_back({Step::Kind::Index, {}, std::stoull(content)});
+    } else {
+      throw invalid("expected an index, '*' or a quoted key at " + std::to_string(pos));
+    }
+    pos = close + 1;
+  }
+}
+
+std::vector<uint64_t> const& CompiledPath::resolve(WisentRootExpression* root,
+                                                   uint64_t generation) const {
+  if(root == cachedRoot && generation == cachedGeneration) {
+    return cachedArguments;
+  }
+  auto const* arguments = getExpressionArguments(root);
+  std::vector<Argument> current{
+      {0, static_cast<WisentArgumentType>(getArgumentType(root, 0) & ~WisentArgumentType_RLE_BIT)}};
+  std::vector<Argument> next;
+  for(auto const& step : steps) {
+    next.clear();
+    for(auto const& argument : current) {
+      if(argument.type != WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+        continue;
+      }
+      auto expressionIndex = arguments[argument.index].asExpression;
+      auto expression = getExpression(root, expressionIndex);
+      switch(step.kind) {
+      case Step::Kind::Key: {
+        if(auto const* keyIndex = getKeyIndexEntry(root, expressionIndex)) {
+          auto argIndex = findKeyArgument(root, keyIndex, step.key.data(), step.key.size());
+          if(argIndex != UINT64_MAX) {
+            next.push_back({argIndex, WisentArgumentType::ARGUMENT_TYPE_EXPRESSION});
+          }
+          break;
+        }
+        forEachRun(root, expression, [&](uint64_t runStart, uint64_t runEnd, auto type) {
+          if(type != WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+            return true;
+          }
+          for(auto argIndex = runStart; argIndex < runEnd; ++argIndex) {
+            if(getHead(root, argIndex) == step.key) {
+              next.push_back({argIndex, type});
+              return false;
+            }
+          }
+          return true;
+        });
+        break;
+      }
+      case Step::Kind::Index: {
+        auto target = expression.startChildOffset + step.index;
+        forEachRun(root, expression, [&](uint64_t /*runStart*/, uint64_t runEnd, auto type) {
+          if(target < runEnd) {
+            next.push_back({target, type});
+            return false;
+          }
+          return true;
+        });
+        break;
+      }
+      case Step::Kind::Wildcard:
+        forEachRun(root, expression, [&](uint64_t runStart, uint64_t runEnd, auto type) {
+          for(auto argIndex = runStart; argIndex < runEnd; ++argIndex) {
+            next.push_back({argIndex, type});
+          }
+          return true;
+        });
+        break;
+      }
+    }
+    std::swap(current, next);
+  }
+  cachedArguments.clear();
+  for(auto const& argument : current) {
+    cachedArguments.push_back(argument.index);
+  }
+  cachedRoot = root;
+  cachedGeneration = generation;
+  return cachedArguments;
+}
+
+extern "C" {
+void* wisentCompilePath(char const* path) {
+  try {
+    return new CompiledPath(path);
+  } catch(std::exception const&) {
+    return nullptr;
+  }
+}
+uint64_t wisentResolvePath(void* compiledPath, char* root, uint64_t generation,
+                           uint64_t const** argumentIndices) {
+  auto const& resolved = static_cast<CompiledPath*>(compiledPath)
+                             ->resolve(reinterpret_cast<WisentRootExpression*>(root), generation);
+  *argumentIndices = resolved.data();
+  return resolved.size();
+}
+void wisentFreePath(void* compiledPath) { delete static_cast<CompiledPath*>(compiledPath); }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "WisentHelpers.h"
+#include <string>
+#include <vector>
+
+namespace wisent {
+namespace path {
+/**
+ * A path to arguments of a Wisent tree, parsed once and resolved to argument indices.
+ * The steps navigate like the benchmarks' LazyExpression:
+ *   name, .name, ["name"]: the first child expression with this head (using the key index if any)
+ *   [n]: the n-th child argument
+ *   [*]: every child argument
+ * e.g. "resources[0][*].path.Table" for the Table of every resource.
+ * The resolution is cached for the last resolved tree and generation, so that resolving the path
+ * again only compares them (not thread-safe: use one CompiledPath per thread).
+ */
+class CompiledPath {
+public:
+  explicit CompiledPath(std::string const& path); // throws std::runtime_error if invalid
+
+  /* the argument indices matching the path (empty if none); generation identifies the tree's
+   * contents at root, e.g. the dataset's generation in the catalog (WisentCatalogEntry) which each
+   * load or append increments */
+  std::vector<uint64_t> const& resolve(WisentRootExpression* root, uint64_t generation) const;
+
+  std::string const& getPath() const { return path; }
+
+private:
+  struct Step {
+    enum class Kind { Key, Index, Wildcard };
+    Kind kind;
+    std::string key;
+    uint64_t index;
+  };
+
+  std::string path;
+  std::vector<Step> steps;
+  mutable WisentRootExpression const* cachedRoot = nullptr;
+  mutable uint64_t cachedGeneration = 0;
+  mutable std::vector<uint64_t> cachedArguments;
+};
+} // namespace path
+} // namespace wisent
@@ -1,54 +1,1117 @@
 #include "WisentSerializer.hpp"
 #include "CsvLoading.hpp"
+#include "CsvReader.hpp"
+#include "MappedFile.hpp"
+#include "SegmentArena.hpp"
 #include "SharedMemorySegment.hpp"
 #include "WisentHelpers.h"
+#include "WisentPath.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fnmatch.h>
 #include <fstream>
+#include <limits>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <numeric>
+#include <optional>
+#include <simdjson.h>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using json = nlohmann::json;
+using wisent::serializer::ColumnProjection;
+using wisent::serializer::CsvParser;
+using wisent::serializer::JsonParser;
+using wisent::serializer::LoadOptions;
+using wisent::serializer::LoadProgress;
+
+/* run func(0..count-1) on up to threadCount threads (including the calling thread) */
+template <typename Func> static void parallelFor(size_t count, unsigned threadCount, Func&& func) {
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  auto worker = [&]() {
+    for(auto i = next++; i < count; i = next++) {
+      try {
+        func(i);
+      } catch(...) {
+        std::lock_guard lock(errorMutex);
+        if(!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for(unsigned i = 1; i < std::min<size_t>(threadCount, count); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for(auto& thread : threads) {
+    thread.join();
+  }
+  if(error) {
+    std::rethrow_exception(error);
+  }
+}
+
+/* setExpression() checking that the offsets fit in the root's expression format */
+static void storeExpression(WisentRootExpression* root, uint64_t expressionIndex,
+                            WisentExpression const& expression) {
+  if((getFormatFlags(root) & WISENT_FORMAT_FLAG_COMPACT_OFFSETS) &&
+     std::max({expression.symbolNameOffset, expression.startChildOffset,
+               expression.endChildOffset}) > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("offsets exceed 32 bits: cannot use the compact offsets format");
+  }
+  setExpression(root, expressionIndex, expression);
+}
+
+/* the version 1 header has no room for the flags, so they all require format version 2 */
+static uint32_t getRequestedFormatFlags(LoadOptions const& options) {
+  uint32_t flags = (options.compactOffsets ? WISENT_FORMAT_FLAG_COMPACT_OFFSETS : 0) |
+                   (options.nullBitmap ? WISENT_FORMAT_FLAG_NULL_BITMAP : 0) |
+                   (options.zoneMapBlockSize > 0 || options.keyIndexMinimumKeys > 0 ||
+                            options.tableSlack > 0
+                        ? WISENT_FORMAT_FLAG_SECTIONS
+                        : 0);
+  if(options.compactOffsets && options.formatVersion < WISENT_FORMAT_VERSION_2) {
+    throw std::runtime_error("compact offsets require format version 2");
+  }
+  if(flags != 0 && options.formatVersion < WISENT_FORMAT_VERSION_2) {
+    throw std::runtime_error(
+        "null bitmaps, zone maps, key indexes and table slack require format version 2");
+  }
+  return flags;
+}
+
+/* statistics of a numeric csv column, before the blocks of all the columns are concatenated */
+struct ColumnZoneMap {
+  WisentColumnStats stats;
+  std::vector<WisentBlockStats> blocks;
+  uint64_t reservedBlocks = 0; // (for the rows of the column's slack)
+};
+
+/* append a (zero-filled) section to the sections following the string buffer */
+static char* appendSection(std::vector<char>& sections, uint32_t kind, uint64_t size) {
+  auto offset = sections.size();
+  sections.resize(offset + sizeof(WisentSectionHeader) + size, 0);
+  auto* header = reinterpret_cast<WisentSectionHeader*>(sections.data() + offset);
+  header->kind = kind;
+  header->size = size;
+  return reinterpret_cast<char*>(header + 1);
+}
+
+static void appendZoneMaps(std::vector<char>& sections, std::vector<ColumnZoneMap> const& columns,
+                           uint64_t blockSize) {
+  uint64_t blockCount = 0;
+  for(auto const& column : columns) {
+    blockCount += std::max<uint64_t>(column.blocks.size(), column.reservedBlocks);
+  }
+  auto* zoneMaps = reinterpret_cast<WisentZoneMaps*>(appendSection(
+      sections, WISENT_SECTION_ZONE_MAPS,
+      sizeof(WisentZoneMaps) + columns.size() * sizeof(WisentColumnStats) +
+          blockCount * sizeof(WisentBlockStats)));
+  zoneMaps->blockSize = blockSize;
+  zoneMaps->columnCount = columns.size();
+  auto* blocks = reinterpret_cast<WisentBlockStats*>(&zoneMaps->columns[columns.size()]);
+  uint64_t firstBlock = 0;
+  for(size_t i = 0; i < columns.size(); ++i) {
+    zoneMaps->columns[i] = columns[i].stats;
+    zoneMaps->columns[i].firstBlock = firstBlock;
+    std::copy(columns[i].blocks.begin(), columns[i].blocks.end(), blocks + firstBlock);
+    firstBlock += std::max<uint64_t>(columns[i].blocks.size(), columns[i].reservedBlocks);
+  }
+}
+
+/* hash table of the keyed children of an expression (see WisentKeyIndex) */
+struct ExpressionKeyIndex {
+  uint64_t expressionIndex;
+  std::vector<uint64_t> slots;
+};
+
+static void appendKeyIndex(std::vector<char>& sections,
+                           std::vector<ExpressionKeyIndex> expressions) {
+  std::sort(expressions.begin(), expressions.end(), [](auto const& lhs, auto const& rhs) {
+    return lhs.expressionIndex < rhs.expressionIndex;
+  });
+  uint64_t slotCount = 0;
+  for(auto const& expression : expressions) {
+    slotCount += expression.slots.size();
+  }
+  auto* keyIndex = reinterpret_cast<WisentKeyIndex*>(
+      appendSection(sections, WISENT_SECTION_KEY_INDEX,
+                    sizeof(WisentKeyIndex) + expressions.size() * sizeof(WisentKeyIndexEntry) +
+                        slotCount * sizeof(uint64_t)));
+  keyIndex->entryCount = expressions.size();
+  auto* slots = reinterpret_cast<uint64_t*>(&keyIndex->entries[expressions.size()]);
+  uint64_t firstSlot = 0;
+  for(size_t i = 0; i < expressions.size(); ++i) {
+    keyIndex->entries[i] = {expressions[i].expressionIndex, firstSlot, expressions[i].slots.size()};
+    std::copy(expressions[i].slots.begin(), expressions[i].slots.end(), slots + firstSlot);
+    firstSlot += expressions[i].slots.size();
+  }
+}
+
+static void appendColumnCapacities(std::vector<char>& sections,
+                                   std::vector<WisentColumnCapacity> const& columns,
+                                   uint64_t stringSlackStart) {
+  auto* capacities = reinterpret_cast<WisentColumnCapacities*>(
+      appendSection(sections, WISENT_SECTION_COLUMN_CAPACITIES,
+                    sizeof(WisentColumnCapacities) +
+                        columns.size() * sizeof(WisentColumnCapacity)));
+  capacities->columnCount = columns.size();
+  capacities->stringSlackStart = stringSlackStart;
+  std::copy(columns.begin(), columns.end(), capacities->columns); // (in expression order)
+}
+
+/* empty rows reserved after a csv column's arguments (or empty bytes after the strings) for
+ * appending rows in place */
+static uint64_t getTableSlack(uint64_t size, double tableSlack) {
+  return static_cast<uint64_t>(std::ceil(static_cast<double>(size) * tableSlack));
+}
+
+static bool isCsvFilename(std::string const& filename) {
+  auto extPos = filename.find_last_of(".");
+  return extPos != std::string::npos && filename.substr(extPos) == ".csv";
+}
+
+/* the indices of the csv file's columns selected by the projection (in the file's order) */
+static std::vector<size_t> getProjectedColumns(std::string const& filename,
+                                               std::vector<std::string> const& columnNames,
+                                               ColumnProjection const& projection) {
+  std::vector<std::string> columnPatterns; // (the patterns applying to this file)
+  for(auto const& pattern : projection.patterns) {
+    auto separator = pattern.find(':');
+    if(separator == std::string::npos) {
+      columnPatterns.push_back(pattern);
+    } else if(fnmatch(pattern.substr(0, separator).c_str(), filename.c_str(), 0) == 0) {
+      columnPatterns.push_back(pattern.substr(separator + 1));
+    }
+  }
+  std::vector<size_t> columns;
+  for(size_t columnIndex = 0; columnIndex < columnNames.size(); ++columnIndex) {
+    if(columnPatterns.empty() ||
+       std::any_of(columnPatterns.begin(), columnPatterns.end(), [&](auto const& pattern) {
+         return fnmatch(pattern.c_str(), columnNames[columnIndex].c_str(), 0) == 0;
+       })) {
+      columns.push_back(columnIndex);
+    }
+  }
+  return columns;
+}
+
+/* CSV files of a load, parsed once and shared by both traversals
+ * (files referenced several times are only parsed once too) */
+class CsvCache {
+public:
+  struct Table {
+    std::unique_ptr<rapidcsv::Document> document; // rapidcsv parser
+    std::unique_ptr<CsvReader> reader;            // native parser
+    std::vector<std::string> columnNames;
+    size_t rowCount = 0;
+    size_t pendingUses = 0; // references counted by the 1st traversal, not yet converted
+    uint64_t fileSize = 0;
+  };
+
+private:
+  std::string const& csvPrefix;
+  CsvParser parser;
+  LoadProgress* progress;
+  std::unordered_map<std::string, Table> tables;
+
+public:
+  CsvCache(std::string const& csvPrefix, CsvParser parser, LoadProgress* progress = nullptr)
+      : csvPrefix(csvPrefix), parser(parser), progress(progress) {}
+
+  /* get a table (parsing the file on its first use) and count a pending use */
+  Table const& retain(std::string const& filename) {
+    auto& table = get(filename);
+    ++table.pendingUses;
+    if(progress != nullptr) {
+      progress->add(0, table.fileSize); // (converted by the 2nd traversal)
+    }
+    return table;
+  }
+
+  /* get a table (parsing the file on its first use) */
+  Table& get(std::string const& filename) {
+    auto [it, inserted] = tables.try_emplace(key(filename));
+    auto& table = it->second;
+    if(!inserted) {
+      return table;
+    }
+    try {
+      if(parser == CsvParser::native) {
+        table.reader = std::make_unique<CsvReader>(csvPrefix + filename);
+        table.columnNames = table.reader->getColumnNames();
+        table.rowCount = table.reader->getRowCount();
+      } else {
+        table.document = std::make_unique<rapidcsv::Document>(openCsvFile(csvPrefix + filename));
+        table.columnNames = table.document->GetColumnNames();
+        table.rowCount = table.document->GetRowCount();
+      }
+    } catch(...) {
+      tables.erase(it);
+      throw;
+    }
+    std::error_code error;
+    table.fileSize = std::filesystem::file_size(csvPrefix + filename, error);
+    table.fileSize = error ? 0 : table.fileSize;
+    if(progress != nullptr) {
+      progress->add(table.fileSize, table.fileSize);
+    }
+    return table;
+  }
+
+  /* done with one use of a table: drop it after its last counted use (at once if its uses were
+   * not counted: a single pass) */
+  void release(std::string const& filename) {
+    auto it = tables.find(key(filename));
+    if(it == tables.end()) {
+      return;
+    }
+    if(it->second.pendingUses > 1) {
+      --it->second.pendingUses;
+      return;
+    }
+    tables.erase(it);
+  }
+
+private:
+  std::string key(std::string const& filename) const {
+    std::error_code error;
+    auto path = std::filesystem::weakly_canonical(csvPrefix + filename, error);
+    return error ? csvPrefix + filename : path.string();
+  }
+};
+
+/* 1st traversal: calculate the total size needed (mirroring the layers built by JsonToWisent)
+ * the string bytes are exact for the json part; csv strings are handled by the buffer growth */
+class JsonArgumentCounter : public json::json_sax_t {
+private:
+  std::vector<uint64_t> argumentCountPerLayer{0};
+  std::vector<bool> wasKeyValue{false};
+  uint64_t layerIndex{0};
+  uint64_t expressionCount{0};
+  uint64_t stringBytes{0};
+  CsvCache& csvCache;
+  LoadOptions const& options;
+
+public:
+  JsonArgumentCounter(CsvCache& csvCache, LoadOptions const& options)
+      : csvCache(csvCache), options(options) {
+    argumentCountPerLayer.reserve(16);
+    wasKeyValue.reserve(16);
+  }
+
+  std::vector<uint64_t>&& getArgumentCountPerLayer() { return std::move(argumentCountPerLayer); }
+  uint64_t getExpressionCount() const { return expressionCount; }
+  uint64_t getStringBytes() const { return stringBytes; }
+
+  bool null() override {
+    addArgument(options.nullBitmap ? 0 : sizeof("Null"));
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool boolean(bool val) override {
+    addArgument(options.nativeBooleans ? 0 : val ? sizeof("True") : sizeof("False"));
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool number_integer(number_integer_t /*val*/) override {
+    addArgument(0);
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool number_unsigned(number_unsigned_t /*val*/) override {
+    addArgument(0);
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool number_float(number_float_t /*val*/, const string_t& /*s*/) override {
+    addArgument(0);
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool string(string_t& val) override {
+    if(!handleCsvFile(val)) {
+      addArgument(val.size() + 1);
+    }
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool start_object(std::size_t /*elements*/) override {
+    startExpression(sizeof("Object"));
+    return true;
+  }
+
+  bool end_object() override {
+    endExpression();
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool start_array(std::size_t /*elements*/) override {
+    startExpression(sizeof("List"));
+    return true;
+  }
+
+  bool end_array() override {
+    endExpression();
+    handleKeyValueEnd();
+    return true;
+  }
+
+  bool key(string_t& val) override {
+    startExpression(val.size() + 1);
+    wasKeyValue[layerIndex] = true;
+    return true;
+  }
+
+  bool binary(json::binary_t& /*val*/) override {
+    throw std::runtime_error("binary value not implemented");
+  }
+
+  bool parse_error(std::size_t position, const std::string& last_token,
+                   const json::exception& ex) override {
+    throw std::runtime_error("parse_error(position=" + std::to_string(position) + ", last_token=" +
+                             last_token + ",\n            ex=" + std::string(ex.what()) + ")");
+  }
 
-class JsonToWisent : public json::json_sax_t {
+private:
+  void addArgument(uint64_t storedStringBytes) {
+    argumentCountPerLayer[layerIndex]++;
+    stringBytes += storedStringBytes;
+  }
+
+  void startExpression(uint64_t headBytes) {
+    addArgument(headBytes);
+    expressionCount++;
+    reserveLayers(++layerIndex + 1);
+  }
+
+  void endExpression() { layerIndex--; }
+
+  void handleKeyValueEnd() {
+    if(wasKeyValue[layerIndex]) {
+      wasKeyValue[layerIndex] = false;
+      endExpression();
+    }
+  }
+
+  void reserveLayers(uint64_t layerCount) {
+    if(argumentCountPerLayer.size() < layerCount) {
+      argumentCountPerLayer.resize(layerCount, 0);
+      wasKeyValue.resize(layerCount, false);
+    }
+  }
+
+  bool handleCsvFile(std::string const& filename) {
+    if(options.disableCsvHandling || !isCsvFilename(filename)) {
+      return false;
+    }
+    auto const& table = csvCache.retain(filename);
+    auto projectedColumns = getProjectedColumns(filename, table.columnNames, options.columns);
+    countCsvTable(table.columnNames, projectedColumns, table.rowCount);
+    return true;
+  }
+
+  /* only the projected columns have data (the others are skipped, or empty placeholders) */
+  void countCsvTable(std::vector<std::string> const& columnNames,
+                     std::vector<size_t> const& projectedColumns, size_t rows) {
+    auto cols = projectedColumns.size();
+    auto tableColumns = options.columns.placeholders ? columnNames.size() : cols;
+    startExpression(sizeof("Table"));
+    static const size_t numTableLayers = 2; // Column/Data
+    reserveLayers(layerIndex + numTableLayers);
+    argumentCountPerLayer[layerIndex] += tableColumns; // Column expressions
+    expressionCount += tableColumns;
+    if(options.columns.placeholders) {
+      for(auto const& columnName : columnNames) {
+        stringBytes += columnName.size() + 1;
+      }
+    } else {
+      for(auto columnIndex : projectedColumns) {
+        stringBytes += columnNames[columnIndex].size() + 1;
+      }
+    }
+    argumentCountPerLayer[layerIndex + 1] += cols * rows; // Column data
+    if(options.tableSlack > 0) {
+      argumentCountPerLayer[layerIndex + 1] += cols * getTableSlack(rows, options.tableSlack);
+    }
+    endExpression();
+  }
+};
+
+/* drive a json SAX handler from a document already parsed by simdjson */
+template <typename Sax> static void saxParse(simdjson::dom::element element, Sax& sax) {
+  switch(element.type()) {
+  case simdjson::dom::element_type::ARRAY: {
+    auto array = element.get_array().value_unsafe();
+    sax.start_array(array.size());
+    for(auto child : array) {
+      saxParse(child, sax);
+    }
+    sax.end_array();
+    break;
+  }
+  case simdjson::dom::element_type::OBJECT: {
+    auto object = element.get_object().value_unsafe();
+    sax.start_object(object.size());
+    for(auto field : object) {
+      std::string key(field.key);
+      sax.key(key);
+      saxParse(field.value, sax);
+    }
+    sax.end_object();
+    break;
+  }
+  case simdjson::dom::element_type::INT64:
+    sax.number_integer(element.get_int64().value_unsafe());
+    break;
+  case simdjson::dom::element_type::UINT64:
+    sax.number_unsigned(element.get_uint64().value_unsafe());
+    break;
+  case simdjson::dom::element_type::DOUBLE:
+    sax.number_float(element.get_double().value_unsafe(), {});
+    break;
+  case simdjson::dom::element_type::STRING: {
+    std::string value(element.get_string().value_unsafe());
+    sax.string(value);
+    break;
+  }
+  case simdjson::dom::element_type::BOOL:
+    sax.boolean(element.get_bool().value_unsafe());
+    break;
+  case simdjson::dom::element_type::NULL_VALUE:
+    sax.null();
+    break;
+  }
+}
+
+/* hash and compare strings already stored in the string buffer, given their offset */
+struct StoredStringHash {
+  WisentRootExpression* const& root;
+  size_t operator()(WisentString offset) const {
+    return std::hash<std::string_view>{}(viewString(root, offset));
+  }
+};
+
+struct StoredStringEqual {
+  WisentRootExpression* const& root;
+  bool operator()(WisentString lhs, WisentString rhs) const {
+    return lhs == rhs || strcmp(viewString(root, lhs), viewString(root, rhs)) == 0;
+  }
+};
+
+/* strings of a column converted by a worker, moved to the string buffer afterwards */
+struct ColumnStrings {
+  std::string buffer;
+  std::vector<uint64_t> argumentIndices;
+
+  size_t add(uint64_t argIndex, std::string_view input) {
+    auto offset = buffer.size();
+    buffer.append(input).push_back('\0');
+    argumentIndices.push_back(argIndex);
+    return offset;
+  }
+
+  /* append a string in place (open, write to the returned buffer, close) */
+  std::string& open(uint64_t argIndex) {
+    argumentIndices.push_back(argIndex);
+    return buffer;
+  }
+  void close() { buffer.push_back('\0'); }
+};
+
+static unsigned getCsvThreadCount(LoadOptions const& options) {
+  return options.csvThreads > 0 ? options.csvThreads
+                                : std::max(1U, std::thread::hardware_concurrency());
+}
+
+static unsigned getParseThreadCount(LoadOptions const& options) {
+  return options.parseThreads > 0 ? options.parseThreads
+                                  : std::max(1U, std::thread::hardware_concurrency());
+}
+
+/* with a null bitmap: a null of the column's type (not breaking the RLE run), else "Missing" */
+static void addMissingCsvValue(WisentRootExpression* root, uint64_t argIndex, bool isDouble,
+                               ColumnStrings& columnStrings) {
+  if(!(getFormatFlags(root) & WISENT_FORMAT_FLAG_NULL_BITMAP)) {
+    *makeSymbolArgument(root, argIndex) = columnStrings.add(argIndex, "Missing");
+    return;
+  }
+  if(isDouble) {
+    *makeDoubleArgument(root, argIndex) = 0.0;
+  } else {
+    *makeLongArgument(root, argIndex) = 0;
+  }
+  setArgumentNull(root, argIndex);
+}
+
+/* convert a column of the native reader: one sweep to infer the type, one to write the values */
+static void convertCsvColumn(WisentRootExpression* root, CsvReader const& reader,
+                             size_t columnIndex, uint64_t argIndex, ColumnStrings& columnStrings) {
+  auto type = reader.inferColumnType(columnIndex);
+  for(size_t row = 0; row < reader.getRowCount(); ++row, ++argIndex) {
+    auto field = reader.getField(row, columnIndex);
+    if(type == CsvReader::ColumnType::String) {
+      *makeStringArgument(root, argIndex) = columnStrings.buffer.size();
+      CsvReader::appendUnquoted(columnStrings.open(argIndex), field);
+      columnStrings.close();
+    } else if(CsvReader::isEmpty(field)) {
+      addMissingCsvValue(root, argIndex, type == CsvReader::ColumnType::Double, columnStrings);
+    } else if(type == CsvReader::ColumnType::Integer) {
+      *makeLongArgument(root, argIndex) = *CsvReader::parseInteger(field);
+    } else {
+      *makeDoubleArgument(root, argIndex) = *CsvReader::parseDouble(field);
+    }
+  }
+}
+
+/* convert a rapidcsv column if all its values are of type T */
+template <typename T>
+static bool convertCsvColumn(WisentRootExpression* root, rapidcsv::Document const& doc,
+                             std::string const& columnName, uint64_t argIndex,
+                             ColumnStrings& columnStrings) {
+  auto column = loadCsvData<T>(doc, columnName);
+  if(column.empty()) {
+    return false;
+  }
+  for(auto const& val : column) {
+    if(!val) {
+      addMissingCsvValue(root, argIndex, std::is_same_v<T, double_t>, columnStrings);
+    } else if constexpr(std::is_same_v<T, int64_t>) {
+      *makeLongArgument(root, argIndex) = *val;
+    } else if constexpr(std::is_same_v<T, double_t>) {
+      *makeDoubleArgument(root, argIndex) = *val;
+    } else {
+      *makeStringArgument(root, argIndex) = columnStrings.add(argIndex, *val);
+    }
+    ++argIndex;
+  }
+  return true;
+}
+
+/* convert a column into its pre-assigned argument range (called from the column workers)
+ * the string values are offsets in columnStrings' buffer until moved to the string buffer */
+static void convertCsvColumn(WisentRootExpression* root, CsvCache::Table const& table,
+                             size_t columnIndex, uint64_t argIndex, ColumnStrings& columnStrings) {
+  if(table.reader) {
+    convertCsvColumn(root, *table.reader, columnIndex, argIndex, columnStrings);
+    return;
+  }
+  auto const& doc = *table.document;
+  auto const& columnName = table.columnNames[columnIndex];
+  if(!convertCsvColumn<int64_t>(root, doc, columnName, argIndex, columnStrings) &&
+     !convertCsvColumn<double_t>(root, doc, columnName, argIndex, columnStrings) &&
+     !convertCsvColumn<std::string>(root, doc, columnName, argIndex, columnStrings)) {
+    throw std::runtime_error("failed to handle csv column: '" + columnName + "'");
+  }
+}
+
+/* set the RLE markers for the runs of identical types in an argument range */
+static void encodeTypeRuns(WisentRootExpression* root, uint64_t begin, uint64_t end) {
+  for(auto runStart = begin; runStart < end;) {
+    auto runEnd = runStart + 1;
+    auto type = getArgumentType(root, runStart);
+    while(runEnd < end && getArgumentType(root, runEnd) == type) {
+      ++runEnd;
+    }
+    if(runEnd - runStart >= WisentArgumentType_RLE_MINIMUM_SIZE) {
+      setRLEArgumentFlagOrPropagateTypes(root, runStart, runEnd - runStart);
+    }
+    runStart = runEnd;
+  }
+}
+
+/* remove the RLE markers of the runs of a column (starting at begin) ending at or after from
+ * (so that the last run can be extended), returning the start of the first decoded run
+ * (from which to encode the runs again) */
+static uint64_t decodeTypeRuns(WisentRootExpression* root, uint64_t begin, uint64_t from,
+                               uint64_t end) {
+  auto decodedStart = from;
+  for(auto runStart = begin; runStart < end;) {
+    auto runEnd = getArgumentRunEnd(root, runStart);
+    if(runEnd >= from && runEnd - runStart > 1) {
+      auto type = static_cast<WisentArgumentType>(getArgumentType(root, runStart) &
+                                                  ~WisentArgumentType_RLE_BIT);
+      for(auto argIndex = runStart; argIndex < runEnd; ++argIndex) {
+        setArgumentType(root, argIndex, type);
+      }
+    }
+    if(runEnd >= from) {
+      decodedStart = std::min(decodedStart, runStart);
+    }
+    runStart = runEnd;
+  }
+  return decodedStart;
+}
+
+static bool isMissingValue(WisentRootExpression* root, uint64_t argIndex) {
+  return getArgumentType(root, argIndex) == WisentArgumentType::ARGUMENT_TYPE_SYMBOL ||
+         isArgumentNull(root, argIndex);
+}
+
+/* the type of the values (not missing) in a range of decoded types, ARGUMENT_TYPE_STRING if
+ * they are not all longs or all doubles, none if all the values are missing */
+static std::optional<WisentArgumentType> getNumericValuesType(WisentRootExpression* root,
+                                                              uint64_t begin, uint64_t end) {
+  std::optional<WisentArgumentType> valuesType;
+  for(auto argIndex = begin; argIndex < end; ++argIndex) {
+    if(isMissingValue(root, argIndex)) {
+      continue;
+    }
+    auto type = getArgumentType(root, argIndex);
+    if((type != WisentArgumentType::ARGUMENT_TYPE_LONG &&
+        type != WisentArgumentType::ARGUMENT_TYPE_DOUBLE) ||
+       (valuesType && *valuesType != type)) {
+      return WisentArgumentType::ARGUMENT_TYPE_STRING;
+    }
+    valuesType = type;
+  }
+  return valuesType;
+}
+
+/* the sum of two long sums, saturated (and kept saturated) at the limits of the 64-bit range */
+static int64_t addSaturated(int64_t sum, int64_t value) {
+  auto const max = std::numeric_limits<int64_t>::max();
+  auto const min = std::numeric_limits<int64_t>::min();
+  if(sum == max || sum == min) {
+    return sum;
+  }
+  if(value == max || value == min) {
+    return value;
+  }
+  int64_t result;
+  if(__builtin_add_overflow(sum, value, &result)) {
+    return value > 0 ? max : min;
+  }
+  return result;
+}
+
+/* merge the stats of a range of values into the stats of a larger range */
+static void mergeBlockStats(WisentBlockStats& stats, WisentBlockStats const& block, bool isDouble) {
+  stats.nullCount += block.nullCount;
+  if(block.count == 0) {
+    return;
+  }
+  if(stats.count == 0) {
+    stats.min = block.min;
+    stats.max = block.max;
+    stats.sum = block.sum;
+  } else if(isDouble) {
+    stats.min.asDouble = std::min(stats.min.asDouble, block.min.asDouble);
+    stats.max.asDouble = std::max(stats.max.asDouble, block.max.asDouble);
+    stats.sum.asDouble += block.sum.asDouble;
+  } else {
+    stats.min.asLong = std::min(stats.min.asLong, block.min.asLong);
+    stats.max.asLong = std::max(stats.max.asLong, block.max.asLong);
+    stats.sum.asLong = addSaturated(stats.sum.asLong, block.sum.asLong);
+  }
+  stats.count += block.count;
+}
+
+/* append the stats of the blocks of blockSize values of a range of decoded types */
+static void computeBlockStats(WisentRootExpression* root, uint64_t begin, uint64_t end,
+                              uint64_t blockSize, bool isDouble,
+                              std::vector<WisentBlockStats>& blocks) {
+  auto const* values = getExpressionArguments(root);
+  for(auto blockStart = begin; blockStart < end; blockStart += blockSize) {
+    WisentBlockStats block{};
+    for(auto argIndex = blockStart; argIndex < std::min(blockStart + blockSize, end);
+        ++argIndex) {
+      if(isMissingValue(root, argIndex)) {
+        ++block.nullCount;
+        continue;
+      }
+      auto value = values[argIndex];
+      mergeBlockStats(block, WisentBlockStats{value, value, value, 1, 0}, isDouble);
+    }
+    blocks.push_back(block);
+  }
+}
+
+/* the whole column's stats from its blocks */
+static void computeColumnTotal(ColumnZoneMap& zoneMap) {
+  auto isDouble =
+      zoneMap.stats.type == static_cast<uint64_t>(WisentArgumentType::ARGUMENT_TYPE_DOUBLE);
+  zoneMap.stats.total = WisentBlockStats{};
+  for(auto const& block : zoneMap.blocks) {
+    mergeBlockStats(zoneMap.stats.total, block, isDouble);
+  }
+  zoneMap.stats.blockCount = zoneMap.blocks.size();
+}
+
+/* min/max/sum/counts of a converted column (before its RLE encoding), per block and in total;
+ * none for a column with strings or without any value */
+static std::optional<ColumnZoneMap> computeZoneMap(WisentRootExpression* root, uint64_t begin,
+                                                   uint64_t end, uint64_t blockSize) {
+  auto valuesType = getNumericValuesType(root, begin, end);
+  if(!valuesType || *valuesType == WisentArgumentType::ARGUMENT_TYPE_STRING) {
+    return {};
+  }
+  ColumnZoneMap zoneMap{};
+  zoneMap.stats.type = static_cast<uint64_t>(*valuesType);
+  computeBlockStats(root, begin, end, blockSize,
+                    *valuesType == WisentArgumentType::ARGUMENT_TYPE_DOUBLE, zoneMap.blocks);
+  computeColumnTotal(zoneMap);
+  return zoneMap;
+}
+
+/* the block slots of a zone-mapped column: its blocks, then the unused ones of its slack */
+static uint64_t getReservedBlocks(WisentRootExpression* root, WisentColumnStats const* column) {
+  auto const* zoneMaps = getZoneMaps(root);
+  auto const* section = reinterpret_cast<WisentSectionHeader const*>(zoneMaps) - 1;
+  auto slotsEnd = (section->size - sizeof(WisentZoneMaps) -
+                   zoneMaps->columnCount * sizeof(WisentColumnStats)) /
+                  sizeof(WisentBlockStats);
+  for(uint64_t i = 0; i < zoneMaps->columnCount; ++i) {
+    if(zoneMaps->columns[i].firstBlock > column->firstBlock) {
+      slotsEnd = std::min(slotsEnd, zoneMaps->columns[i].firstBlock);
+    }
+  }
+  return slotsEnd - column->firstBlock;
+}
+
+/* the stats of a zone-mapped column after appending rows, written once the rows are published */
+struct ZoneMapUpdate {
+  WisentColumnStats* column = nullptr; // (none to write)
+  WisentColumnStats stats{};
+  uint64_t firstBlock = 0; // (the previous last block if the new rows complete it)
+  std::vector<WisentBlockStats> blocks;
+};
+
+/* the stats of a column after appending the rows [oldEnd, end) (with decoded types): the last
+ * partial block merges the new rows' first values, the next blocks go in the column's slack */
+static ZoneMapUpdate computeZoneMapUpdate(WisentRootExpression* root, uint64_t begin,
+                                          uint64_t oldEnd, uint64_t end, uint64_t blockSize,
+                                          WisentColumnStats* column) {
+  if(oldEnd == end ||
+     column->type == static_cast<uint64_t>(WisentArgumentType::ARGUMENT_TYPE_STRING)) {
+    return {};
+  }
+  ZoneMapUpdate update{column, *column, column->blockCount, {}};
+  auto valuesType = getNumericValuesType(root, oldEnd, end);
+  if(valuesType && *valuesType != static_cast<WisentArgumentType>(column->type)) {
+    // no statistics for mixed types
+    update.stats.type = static_cast<uint64_t>(WisentArgumentType::ARGUMENT_TYPE_STRING);
+    update.stats.blockCount = 0;
+    update.stats.total = WisentBlockStats{};
+    return update;
+  }
+  auto isDouble = column->type == static_cast<uint64_t>(WisentArgumentType::ARGUMENT_TYPE_DOUBLE);
+  auto firstBlockEnd = std::min(end, begin + ((oldEnd - begin) / blockSize + 1) * blockSize);
+  computeBlockStats(root, oldEnd, firstBlockEnd, blockSize, isDouble, update.blocks);
+  computeBlockStats(root, firstBlockEnd, end, blockSize, isDouble, update.blocks);
+  for(auto const& block : update.blocks) {
+    mergeBlockStats(update.stats.total, block, isDouble);
+  }
+  if((oldEnd - begin) % blockSize != 0) {
+    update.firstBlock = column->blockCount - 1;
+    auto lastBlock = getBlockStats(root, column)[update.firstBlock];
+    mergeBlockStats(lastBlock, update.blocks.front(), isDouble);
+    update.blocks.front() = lastBlock;
+  }
+  update.stats.blockCount = update.firstBlock + update.blocks.size();
+  if(update.stats.blockCount > getReservedBlocks(root, column)) {
+    auto name = getExpression(root, column->expressionIndex).symbolNameOffset;
+    throw std::runtime_error("no zone map blocks left to append rows to: " +
+                             std::string(viewString(root, name)));
+  }
+  return update;
+}
+
+/* the bytes of the sections following the string buffer (including the end section) */
+static uint64_t getSectionsSize(WisentRootExpression* root) {
+  if(!(getFormatFlags(root) & WISENT_FORMAT_FLAG_SECTIONS)) {
+    return 0;
+  }
+  auto const* bytes = reinterpret_cast<char const*>(root) + getSectionsOffset(root);
+  auto const* header = reinterpret_cast<WisentSectionHeader const*>(bytes);
+  for(; header->kind != WISENT_SECTION_END;
+      header = reinterpret_cast<WisentSectionHeader const*>(reinterpret_cast<char const*>(
+          header + 1) + header->size)) {
+  }
+  return reinterpret_cast<char const*>(header + 1) - bytes;
+}
+
+/* copy the null bits of an argument range (the target's bits must be cleared) */
+static void copyNullBits(WisentRootExpression* source, uint64_t sourceStart,
+                         WisentRootExpression* target, uint64_t targetStart, uint64_t size) {
+  auto const* words = getNullBitmap(source);
+  for(auto i = sourceStart; i < sourceStart + size;) {
+    auto word = words[i / 64] >> (i % 64);
+    if(word == 0) {
+      i += 64 - i % 64; // skip the rest of the word
+      continue;
+    }
+    if(word & 1) {
+      setArgumentNull(target, targetStart + i - sourceStart);
+    }
+    ++i;
+  }
+}
+
+template <typename Memory> class JsonToWisent : public json::json_sax_t {
 private:
   WisentRootExpression* root;
   std::vector<uint64_t> cumulArgCountPerLayer;
+  std::vector<uint64_t> layerCapacityEnds; // (where the next layer's arguments start)
   std::vector<bool> wasKeyValue;
   std::vector<uint64_t> argumentIteratorStack{0};
   std::vector<uint64_t> expressionIndexStack{0};
   uint64_t nextExpressionIndex{0};
   uint64_t layerIndex{0};
-  SharedMemorySegment& sharedMemory;
-  std::string const& csvPrefix;
-  bool disableRLE;
-  bool disableCsvHandling;
+  Memory& memory;
+  CsvCache& csvCache;
+  LoadOptions const& options;
   uint64_t numRepeatedArgumentTypes; // count repeated type for triggering RLE encoding
+  uint64_t stringBufferCapacity;     // bytes reserved after the string buffer's start
+  std::unordered_set<WisentString, StoredStringHash, StoredStringEqual> internedStrings;
+  std::vector<ColumnZoneMap> zoneMaps;      // (options.zoneMapBlockSize)
+  std::vector<ExpressionKeyIndex> keyIndex; // (options.keyIndexMinimumKeys)
+  std::vector<WisentColumnCapacity> columnCapacities; // (options.tableSlack)
+  uint64_t stringSlackStart = 0;                      // (after reserveStringSlack())
+
+  template <typename> friend class JsonToWisent; // (stitching the chunks' trees)
 
 public:
   JsonToWisent(uint64_t expressionCount, std::vector<uint64_t>&& argumentCountPerLayer,
-               SharedMemorySegment& sharedMemory, std::string const& csvPrefix, bool disableRLE,
-               bool disableCsvHandling)
-      : root(nullptr), cumulArgCountPerLayer(std::move(argumentCountPerLayer)),
-        sharedMemory(sharedMemory), csvPrefix(csvPrefix), disableRLE(disableRLE),
-        disableCsvHandling(disableCsvHandling), numRepeatedArgumentTypes(0) {
+               uint64_t stringBufferSizeHint, Memory& memory, CsvCache& csvCache,
+               LoadOptions const& options, uint32_t formatFlags)
+      : root(nullptr), cumulArgCountPerLayer(std::move(argumentCountPerLayer)), memory(memory),
+        csvCache(csvCache), options(options),
+        numRepeatedArgumentTypes(0), stringBufferCapacity(0),
+        internedStrings(0, StoredStringHash{root}, StoredStringEqual{root}) {
     // we need the accumulated count at each layer
     std::partial_sum(cumulArgCountPerLayer.begin(), cumulArgCountPerLayer.end(),
                      cumulArgCountPerLayer.begin());
-    root =
-        allocateExpressionTree(cumulArgCountPerLayer.back(), expressionCount, sharedMemoryMalloc);
+    layerCapacityEnds = cumulArgCountPerLayer;
+    auto argumentCount = cumulArgCountPerLayer.back();
+    root = initExpressionTree(memory.malloc(getExpressionTreeSize(argumentCount, expressionCount,
+                                                                  options.formatVersion,
+                                                                  formatFlags)),
+                              argumentCount, expressionCount, options.formatVersion, formatFlags);
+    if constexpr(!std::is_same_v<Memory, ReservedMemoryRange>) {
+      // (reserved ranges are zero-filled on first touch)
+      memset(getNullBitmap(root), 0, getNullBitmapSize(argumentCount, formatFlags));
+    }
     wasKeyValue.resize(cumulArgCountPerLayer.size(), false);
+    reserveStringBuffer(stringBufferSizeHint);
   }
 
   WisentRootExpression* getRoot() { return root; }
 
+  /* for each layer, the end of the arguments written so far in the next layer */
+  std::vector<uint64_t> const& getLayerEnds() const { return cumulArgCountPerLayer; }
+
+  uint64_t getExpressionCount() const { return nextExpressionIndex; }
+
+  std::vector<char> getSections() const {
+    if(!(getFormatFlags(root) & WISENT_FORMAT_FLAG_SECTIONS)) {
+      return {};
+    }
+    std::vector<char> sections;
+    if(options.zoneMapBlockSize > 0) {
+      appendZoneMaps(sections, zoneMaps, options.zoneMapBlockSize);
+    }
+    if(options.keyIndexMinimumKeys > 0) {
+      appendKeyIndex(sections, keyIndex);
+    }
+    if(options.tableSlack > 0) {
+      appendColumnCapacities(sections, columnCapacities, stringSlackStart);
+    }
+    appendSection(sections, WISENT_SECTION_END, 0);
+    return sections;
+  }
+
+  /* the top-level expression from the trees of chunks of its elements (in order), built from
+   * the chunks' own documents: the chunks' layers are concatenated, their expression indices and
+   * string offsets shifted, then the top-level arguments' RLE runs are encoded again across the
+   * chunks (see serializeChunks) */
+  template <typename ChunkMemory>
+  void stitchChunks(std::string const& head,
+                    std::vector<std::unique_ptr<JsonToWisent<ChunkMemory>>> const& chunks,
+                    unsigned threadCount) {
+    startExpression(head);
+    auto headBytes = head.size() + 1; // (each chunk's tree starts with its own copy)
+    // where each chunk's part of each layer, its expressions and its strings start
+    std::vector<std::vector<uint64_t>> layerStarts(chunks.size());
+    std::vector<uint64_t> expressionStarts(chunks.size());
+    std::vector<uint64_t> stringStarts(chunks.size());
+    std::vector<uint64_t> nextLayerStarts(cumulArgCountPerLayer.size());
+    for(size_t layer = 1; layer < nextLayerStarts.size(); ++layer) {
+      nextLayerStarts[layer] = cumulArgCountPerLayer[layer - 1];
+    }
+    auto nextExpressionStart = nextExpressionIndex;
+    auto nextStringStart = root->stringArgumentsFillIndex;
+    for(size_t chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+      auto const& chunk = *chunks[chunkIndex];
+      layerStarts[chunkIndex] = nextLayerStarts;
+      for(size_t layer = 1; layer < chunk.cumulArgCountPerLayer.size(); ++layer) {
+        nextLayerStarts[layer] += chunk.getLayerEnd(layer) - chunk.getLayerStart(layer);
+      }
+      expressionStarts[chunkIndex] = nextExpressionStart;
+      nextExpressionStart += chunk.nextExpressionIndex - 1;
+      stringStarts[chunkIndex] = nextStringStart;
+      nextStringStart += chunk.root->stringArgumentsFillIndex - headBytes;
+    }
+    reserveStringBuffer(nextStringStart - root->stringArgumentsFillIndex);
+    parallelFor(chunks.size(), threadCount, [&](size_t chunkIndex) {
+      auto const& chunk = *chunks[chunkIndex];
+      auto const& starts = layerStarts[chunkIndex];
+      auto expressionShift = expressionStarts[chunkIndex] - 1; // (without the chunk's top level)
+      auto stringShift = stringStarts[chunkIndex] - headBytes;
+      auto typeSize = getArgumentTypeSize(getFormatVersion(root));
+      for(size_t layer = 1; layer < chunk.cumulArgCountPerLayer.size(); ++layer) {
+        auto chunkStart = chunk.getLayerStart(layer);
+        auto size = chunk.getLayerEnd(layer) - chunkStart;
+        memcpy(&getExpressionArguments(root)[starts[layer]],
+               &getExpressionArguments(chunk.root)[chunkStart], size * sizeof(WisentArgumentValue));
+        memcpy(getArgumentTypesBuffer(root) + starts[layer] * typeSize,
+               getArgumentTypesBuffer(chunk.root) + chunkStart * typeSize, size * typeSize);
+        if(getFormatFlags(root) & WISENT_FORMAT_FLAG_NULL_BITMAP) {
+          copyNullBits(chunk.root, chunkStart, root, starts[layer], size);
+        }
+        for(auto argIndex = chunkStart; argIndex < chunkStart + size;) {
+          auto runEnd = getArgumentRunEnd(chunk.root, argIndex);
+          auto type = getArgumentType(chunk.root, argIndex) & ~WisentArgumentType_RLE_BIT;
+          auto* value = &getExpressionArguments(root)[starts[layer] + argIndex - chunkStart];
+          if(type == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+            // its children are in the next layer
+            auto expression = getExpression(chunk.root, value->asExpression);
+            auto childShift = starts[layer + 1] - chunk.getLayerStart(layer + 1);
+            expression.symbolNameOffset += stringShift;
+            expression.startChildOffset += childShift;
+            expression.endChildOffset += childShift;
+            value->asExpression += expressionShift;
+            storeExpression(root, value->asExpression, expression);
+          } else if(type == WisentArgumentType::ARGUMENT_TYPE_STRING ||
+                    type == WisentArgumentType::ARGUMENT_TYPE_SYMBOL) {
+            for(auto runIndex = argIndex; runIndex < runEnd; ++runIndex, ++value) {
+              if(!isArgumentNull(chunk.root, runIndex)) {
+                value->asString += stringShift;
+              }
+            }
+          }
+          argIndex = runEnd;
+        }
+      }
+      memcpy(getStringBuffer(root) + stringStarts[chunkIndex],
+             getStringBuffer(chunk.root) + headBytes,
+             chunk.root->stringArgumentsFillIndex - headBytes);
+    });
+    for(size_t chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+      for(auto const& index : chunks[chunkIndex]->keyIndex) {
+        if(index.expressionIndex != 0) { // (the chunk's top level: indexed once stitched)
+          keyIndex.push_back({index.expressionIndex + expressionStarts[chunkIndex] - 1,
+                              index.slots});
+        }
+      }
+    }
+    nextExpressionIndex = nextExpressionStart;
+    root->stringArgumentsFillIndex = nextStringStart;
+    for(size_t layer = 2; layer < nextLayerStarts.size(); ++layer) {
+      cumulArgCountPerLayer[layer - 1] = nextLayerStarts[layer];
+    }
+    // the top-level arguments, as if added in sequence (runs and nulls span the chunks)
+    auto begin = cumulArgCountPerLayer[0];
+    auto end = nextLayerStarts[1];
+    decodeTypeRuns(root, begin, begin, end);
+    for(auto argIndex = begin; argIndex < end; ++argIndex) {
+      auto type = getArgumentType(root, argIndex);
+      if(type == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+        resetTypeRLE(argIndex);
+        continue;
+      }
+      if(isArgumentNull(root, argIndex)) {
+        type = argIndex == begin ? WisentArgumentType::ARGUMENT_TYPE_LONG
+                                 : getArgumentType(root, argIndex - 1);
+        if(type == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+          type = WisentArgumentType::ARGUMENT_TYPE_LONG;
+        }
+        setArgumentType(root, argIndex, type);
+      }
+      applyTypeRLE(argIndex);
+    }
+    argumentIteratorStack.back() = end - begin;
+    endExpression();
+  }
+
+  /* with table slack, reserve zero bytes at the end of the string buffer for the strings of the
+   * appended rows (see WisentColumnCapacities) */
+  void reserveStringSlack() {
+    stringSlackStart = root->stringArgumentsFillIndex;
+    if(columnCapacities.empty()) {
+      return;
+    }
+    auto slackBytes = getTableSlack(root->stringArgumentsFillIndex, options.tableSlack);
+    reserveStringBuffer(slackBytes);
+    memset(getStringBuffer(root) + stringSlackStart, 0, slackBytes);
+    root->stringArgumentsFillIndex += slackBytes;
+  }
+
+  /* release the unused part of the reserved string buffer and append the sections */
+  void finish() {
+    reserveStringSlack();
+    auto sections = getSections();
+    if(sections.empty()) {
+      shrinkStringBufferToFit();
+      return;
+    }
+    auto stringBufferEnd = getStringBufferOffset(root) + root->stringArgumentsFillIndex;
+    auto sectionsOffset = getSectionsOffset(root);
+    stringBufferCapacity = sectionsOffset + sections.size() - getStringBufferOffset(root);
+    root = static_cast<WisentRootExpression*>(
+        memory.realloc(root, sectionsOffset + sections.size()));
+    auto* bytes = reinterpret_cast<char*>(root);
+    memset(bytes + stringBufferEnd, 0, sectionsOffset - stringBufferEnd);
+    memcpy(bytes + sectionsOffset, sections.data(), sections.size());
+  }
+
+  /* release the unused part of the reserved string buffer */
+  void shrinkStringBufferToFit() {
+    if(stringBufferCapacity == root->stringArgumentsFillIndex) {
+      return;
+    }
+    stringBufferCapacity = root->stringArgumentsFillIndex;
+    root = static_cast<WisentRootExpression*>(
+        memory.realloc(root, getStringBufferOffset(root) + stringBufferCapacity));
+  }
+
   bool null() override {
-    addSymbol("Null");
+    if(getFormatFlags(root) & WISENT_FORMAT_FLAG_NULL_BITMAP) {
+      addNull();
+    } else {
+      addSymbol("Null");
+    }
     handleKeyValueEnd();
     return true;
   }
 
   bool boolean(bool val) override {
-    addSymbol(val ? "True" : "False");
+    if(options.nativeBooleans) {
+      addBool(val);
+    } else {
+      addSymbol(val ? "True" : "False");
+    }
     handleKeyValueEnd();
     return true;
   }
@@ -125,20 +1188,38 @@ public:
   }
 
 private:
+  /* (once parsed) the arguments of a layer */
+  uint64_t getLayerStart(size_t layer) const {
+    return layer == 1 ? 1 : cumulArgCountPerLayer[layer - 2];
+  }
+  uint64_t getLayerEnd(size_t layer) const { return cumulArgCountPerLayer[layer - 1]; }
+
   uint64_t getNextArgumentIndex() {
-    return getExpressionSubexpressions(root)[expressionIndexStack.back()].startChildOffset +
-           argumentIteratorStack.back()++;
+    auto argIndex = getExpression(root, expressionIndexStack.back()).startChildOffset +
+                    argumentIteratorStack.back()++;
+    checkLayerCapacity(layerIndex, argIndex + 1);
+    return argIndex;
+  }
+
+  /* before writing them: the arguments up to end fit in the layer as counted (or reserved by a
+   * single pass, which does not count them) */
+  void checkLayerCapacity(uint64_t layer, uint64_t end) const {
+    if(end > layerCapacityEnds[layer]) {
+      auto start = layer > 0 ? layerCapacityEnds[layer - 1] : 0;
+      throw std::runtime_error("layer " + std::to_string(layer) + " exceeds its capacity of " +
+                               std::to_string(layerCapacityEnds[layer] - start) + " arguments");
+    }
   }
 
   void applyTypeRLE(std::uint64_t argIndex) {
-    if(disableRLE) {
+    if(options.disableRLE) {
       return;
     }
     if(numRepeatedArgumentTypes == 0) {
       numRepeatedArgumentTypes = 1;
       return;
     }
-    if(getArgumentTypes(root)[argIndex - 1] != getArgumentTypes(root)[argIndex]) {
+    if(getArgumentType(root, argIndex - 1) != getArgumentType(root, argIndex)) {
       resetTypeRLE(argIndex);
       numRepeatedArgumentTypes = 1;
       return;
@@ -154,6 +1235,27 @@ private:
     numRepeatedArgumentTypes = 0;
   }
 
+  void addBool(bool input) {
+    uint64_t argIndex = getNextArgumentIndex();
+    *makeBoolArgument(root, argIndex) = input;
+    applyTypeRLE(argIndex);
+  }
+
+  /* a zero value with the type of the previous sibling (to continue its RLE run) */
+  void addNull() {
+    auto isFirstArgument = argumentIteratorStack.back() == 0;
+    uint64_t argIndex = getNextArgumentIndex();
+    auto type = isFirstArgument ? WisentArgumentType::ARGUMENT_TYPE_LONG
+                                : getArgumentType(root, argIndex - 1);
+    if(type == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+      type = WisentArgumentType::ARGUMENT_TYPE_LONG;
+    }
+    getExpressionArguments(root)[argIndex].asLong = 0;
+    setArgumentType(root, argIndex, type);
+    setArgumentNull(root, argIndex);
+    applyTypeRLE(argIndex);
+  }
+
   void addLong(std::int64_t input) {
     uint64_t argIndex = getNextArgumentIndex();
     *makeLongArgument(root, argIndex) = input;
@@ -166,15 +1268,41 @@ private:
     applyTypeRLE(argIndex);
   }
 
+  /* grow geometrically, so that the segment is remapped O(log n) times instead of once per
+   * string */
+  void reserveStringBuffer(uint64_t size) {
+    auto requiredCapacity = root->stringArgumentsFillIndex + size;
+    if(requiredCapacity <= stringBufferCapacity) {
+      return;
+    }
+    stringBufferCapacity = std::max(requiredCapacity, stringBufferCapacity * 2);
+    root = static_cast<WisentRootExpression*>(
+        memory.realloc(root, getStringBufferOffset(root) + stringBufferCapacity));
+  }
+
+  size_t storeString(std::string_view input) {
+    reserveStringBuffer(input.size() + 1);
+    auto storedString = storeStringInPlace(root, input.data(), input.size());
+    if(options.internStrings) {
+      auto [it, inserted] = internedStrings.insert(storedString);
+      if(!inserted) {
+        // already in the buffer: drop the copy and point to the first occurrence instead
+        root->stringArgumentsFillIndex = storedString;
+        return *it;
+      }
+    }
+    return storedString;
+  }
+
   void addString(std::string const& input) {
-    auto storedString = storeString(&root, input.c_str(), sharedMemoryRealloc);
+    auto storedString = storeString(input);
     uint64_t argIndex = getNextArgumentIndex();
     *makeStringArgument(root, argIndex) = storedString;
     applyTypeRLE(argIndex);
   }
 
   void addSymbol(std::string const& symbol) {
-    auto storedString = storeString(&root, symbol.c_str(), sharedMemoryRealloc);
+    auto storedString = storeString(symbol);
     uint64_t argIndex = getNextArgumentIndex();
     *makeSymbolArgument(root, argIndex) = storedString;
     applyTypeRLE(argIndex);
@@ -187,166 +1315,999 @@ private:
   }
 
   void startExpression(std::string const& head) {
+    if(layerIndex + 1 >= cumulArgCountPerLayer.size()) {
+      throw std::runtime_error("too many nested layers (" + std::to_string(layerIndex + 1) + ")");
+    }
+    if(nextExpressionIndex >= root->expressionCount) {
+      throw std::runtime_error("more than " + std::to_string(root->expressionCount) +
+                               " expressions");
+    }
     auto expressionIndex = nextExpressionIndex++;
     addExpression(expressionIndex);
-    auto storedString = storeString(&root, head.c_str(), sharedMemoryRealloc);
+    auto storedString = storeString(head);
     auto startChildOffset = cumulArgCountPerLayer[layerIndex++];
-    *makeExpression(root, expressionIndex) = WisentExpression{
-        storedString, startChildOffset,
-        0 // not known yet; set during endExpression()
-    };
+    storeExpression(root, expressionIndex,
+                    WisentExpression{
+                        storedString, startChildOffset,
+                        0 // not known yet; set during endExpression()
+                    });
     argumentIteratorStack.push_back(0);
     expressionIndexStack.push_back(expressionIndex);
   }
 
-  void endExpression() {
-    auto& expression = getExpressionSubexpressions(root)[expressionIndexStack.back()];
+  /* (keyed: whether the children can be key-value expressions, to index if there are many) */
+  void endExpression(bool keyed = true) {
+    auto expression = getExpression(root, expressionIndexStack.back());
     expression.endChildOffset = expression.startChildOffset + argumentIteratorStack.back();
+    storeExpression(root, expressionIndexStack.back(), expression);
     resetTypeRLE(expression.endChildOffset);
+    if(keyed && options.keyIndexMinimumKeys > 0) {
+      addKeyIndex(expressionIndexStack.back(), expression);
+    }
     argumentIteratorStack.pop_back();
     expressionIndexStack.pop_back();
     cumulArgCountPerLayer[--layerIndex] = expression.endChildOffset;
   }
 
+  /* add a hash table of the keyed children if there are at least keyIndexMinimumKeys of them */
+  void addKeyIndex(uint64_t expressionIndex, WisentExpression const& expression) {
+    auto forEachChild = [&](auto&& func) {
+      for(auto argIndex = expression.startChildOffset; argIndex < expression.endChildOffset;
+          argIndex = getArgumentRunEnd(root, argIndex)) {
+        if(getArgumentType(root, argIndex) == WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+          func(argIndex - expression.startChildOffset);
+        }
+      }
+    };
+    uint64_t childCount = 0;
+    forEachChild([&](uint64_t /*childOffset*/) { ++childCount; });
+    if(childCount < options.keyIndexMinimumKeys) {
+      return;
+    }
+    uint64_t slotCount = 1;
+    while(slotCount < 2 * childCount) {
+      slotCount *= 2;
+    }
+    auto& index = keyIndex.emplace_back(ExpressionKeyIndex{
+        expressionIndex, std::vector<uint64_t>(slotCount, WISENT_KEY_INDEX_EMPTY_SLOT)});
+    auto childKey = [&](uint64_t childOffset) {
+      auto child = getExpressionArguments(root)[expression.startChildOffset + childOffset];
+      return std::string_view(
+          viewString(root, getExpression(root, child.asExpression).symbolNameOffset));
+    };
+    forEachChild([&](uint64_t childOffset) {
+      auto key = childKey(childOffset);
+      auto slot = hashKey(key.data(), key.size()) & (slotCount - 1);
+      while(index.slots[slot] != WISENT_KEY_INDEX_EMPTY_SLOT &&
+            childKey(index.slots[slot]) != key) {
+        slot = (slot + 1) & (slotCount - 1);
+      }
+      if(index.slots[slot] == WISENT_KEY_INDEX_EMPTY_SLOT) {
+        index.slots[slot] = childOffset; // (duplicated keys: the first child is found)
+      }
+    });
+  }
+
   bool handleCsvFile(std::string const& filename) {
-    if(disableCsvHandling) {
+    if(options.disableCsvHandling || !isCsvFilename(filename)) {
       return false;
     }
-    auto extPos = filename.find_last_of(".");
-    if(extPos == std::string::npos || filename.substr(extPos) != ".csv") {
-      return false;
+    auto const& table = csvCache.get(filename);
+    handleCsvTable(table, getProjectedColumns(filename, table.columnNames, options.columns));
+    if(options.progress != nullptr) {
+      // (the 1st traversal counted the conversion in the total)
+      options.progress->add(table.fileSize, options.singlePass ? table.fileSize : 0);
     }
+    csvCache.release(filename);
+    return true;
+  }
+
+  /* lay out a Table expression and convert its projected columns in parallel */
+  void handleCsvTable(CsvCache::Table const& table, std::vector<size_t> const& projectedColumns) {
+    auto const& columnNames = table.columnNames;
+    auto rows = table.rowCount;
     startExpression("Table");
-    auto doc = openCsvFile(csvPrefix + filename);
-    for(auto const& columnName : doc.GetColumnNames()) {
-      if(!handleCsvColumn<int64_t>(doc, columnName, [this](auto val) { addLong(val); })) {
-        if(!handleCsvColumn<double_t>(doc, columnName, [this](auto val) { addDouble(val); })) {
-          if(!handleCsvColumn<std::string>(doc, columnName,
-                                           [this](auto const& val) { addString(val); })) {
-            throw std::runtime_error("failed to handle csv column: '" + columnName + "'");
-          }
+    // the column expressions and their argument ranges are known before converting any data
+    std::vector<uint64_t> columnExpressions; // (of the projected columns)
+    for(size_t columnIndex = 0; columnIndex < columnNames.size(); ++columnIndex) {
+      auto projected = columnExpressions.size() < projectedColumns.size() &&
+                       projectedColumns[columnExpressions.size()] == columnIndex;
+      if(!projected && !options.columns.placeholders) {
+        continue;
+      }
+      startExpression(columnNames[columnIndex]);
+      if(!projected) {
+        endExpression(false); // (a placeholder: no rows, no slack)
+        continue;
+      }
+      columnExpressions.push_back(nextExpressionIndex - 1);
+      argumentIteratorStack.back() += rows; // filled by the column workers
+      endExpression(false);
+      if(options.tableSlack > 0) {
+        auto slackRows = getTableSlack(rows, options.tableSlack);
+        cumulArgCountPerLayer[layerIndex] += slackRows; // (empty arguments after the column's)
+        columnCapacities.push_back({nextExpressionIndex - 1, rows + slackRows, columnIndex});
+      }
+      checkLayerCapacity(layerIndex + 1, cumulArgCountPerLayer[layerIndex]);
+    }
+    std::vector<ColumnStrings> strings(projectedColumns.size());
+    std::vector<std::optional<ColumnZoneMap>> columnZoneMaps(projectedColumns.size());
+    parallelFor(projectedColumns.size(), getCsvThreadCount(options), [&](size_t columnIndex) {
+      auto begin = getExpression(root, columnExpressions[columnIndex]).startChildOffset;
+      if(rows > 0) {
+        convertCsvColumn(root, table, projectedColumns[columnIndex], begin, strings[columnIndex]);
+      }
+      if(options.zoneMapBlockSize > 0) {
+        columnZoneMaps[columnIndex] =
+            computeZoneMap(root, begin, begin + rows, options.zoneMapBlockSize);
+      }
+      if(!options.disableRLE) {
+        encodeTypeRuns(root, begin, begin + rows);
+      }
+    });
+    for(size_t columnIndex = 0; columnIndex < projectedColumns.size(); ++columnIndex) {
+      if(columnZoneMaps[columnIndex]) {
+        columnZoneMaps[columnIndex]->stats.expressionIndex = columnExpressions[columnIndex];
+        if(options.tableSlack > 0) { // (room for the blocks of the appended rows)
+          auto capacity = rows + getTableSlack(rows, options.tableSlack);
+          columnZoneMaps[columnIndex]->reservedBlocks =
+              (capacity + options.zoneMapBlockSize - 1) / options.zoneMapBlockSize;
+        }
+        zoneMaps.emplace_back(std::move(*columnZoneMaps[columnIndex]));
+      }
+    }
+    // sequential fix-up: move the strings into the (growing) string buffer
+    for(auto const& columnStrings : strings) {
+      if(options.internStrings) {
+        for(auto argIndex : columnStrings.argumentIndices) {
+          auto& value = getExpressionArguments(root)[argIndex].asString;
+          value = storeString(columnStrings.buffer.c_str() + value);
         }
+        continue;
+      }
+      reserveStringBuffer(columnStrings.buffer.size());
+      auto baseOffset = root->stringArgumentsFillIndex;
+      memcpy(getStringBuffer(root) + baseOffset, columnStrings.buffer.data(),
+             columnStrings.buffer.size());
+      root->stringArgumentsFillIndex += columnStrings.buffer.size();
+      for(auto argIndex : columnStrings.argumentIndices) {
+        getExpressionArguments(root)[argIndex].asString += baseOffset;
       }
     }
     endExpression();
-    return true;
   }
 
-  template <typename T, typename Func>
-  bool handleCsvColumn(rapidcsv::Document const& doc, std::string const& columnName,
-                       Func&& addValueFunc) {
-    auto column = loadCsvData<T>(doc, columnName);
-    if(column.empty()) {
-      return false;
-    }
-    // store as a column expression
-    startExpression(columnName);
-    for(auto const& val : column) {
-      val ? addValueFunc(*val) : addSymbol("Missing");
+};
+
+/* single-pass mode: layers are staged at fixed offsets in a reserved address range (after the
+ * root expression's argument) */
+static uint64_t const singlePassMaxLayers = 32;
+static uint64_t const singlePassLayerCapacity = uint64_t{1} << 32;
+static uint64_t const singlePassExpressionCapacity = uint64_t{1} << 32;
+static uint64_t const singlePassStringCapacity = uint64_t{1} << 40;
+
+/* copy a tree with widely spaced layers into the compact layer-ordered layout */
+template <typename Memory>
+static WisentRootExpression* compactLayers(WisentRootExpression* staged,
+                                           std::vector<uint64_t> const& layerStarts,
+                                           std::vector<uint64_t> const& layerEnds,
+                                           uint64_t expressionCount, uint32_t formatFlags,
+                                           std::vector<char> const& sections, Memory& memory) {
+  // the root expression's argument is alone in the first layer
+  std::vector<uint64_t> stagedStarts{0};
+  std::vector<uint64_t> compactStarts{0};
+  std::vector<uint64_t> sizes{1};
+  for(size_t layer = 0; layer < layerStarts.size(); ++layer) {
+    auto size = layerEnds[layer] - layerStarts[layer];
+    compactStarts.push_back(compactStarts.back() + sizes.back());
+    stagedStarts.push_back(layerStarts[layer]);
+    sizes.push_back(size);
+  }
+  auto argumentCount = compactStarts.back() + sizes.back();
+  auto stringBytes = staged->stringArgumentsFillIndex;
+  auto formatVersion = getFormatVersion(staged);
+  auto treeSize = getExpressionTreeSize(argumentCount, expressionCount, formatVersion, formatFlags);
+  auto sectionsOffset = (treeSize + stringBytes + 7) & ~uint64_t{7};
+  auto* root = initExpressionTree(
+      memory.malloc(sections.empty() ? treeSize + stringBytes : sectionsOffset + sections.size()),
+      argumentCount, expressionCount, formatVersion, formatFlags);
+  memset(getNullBitmap(root), 0, getNullBitmapSize(argumentCount, formatFlags));
+  auto typeSize = getArgumentTypeSize(formatVersion);
+  for(size_t layer = 0; layer < sizes.size(); ++layer) {
+    memcpy(&getExpressionArguments(root)[compactStarts[layer]],
+           &getExpressionArguments(staged)[stagedStarts[layer]],
+           sizes[layer] * sizeof(WisentArgumentValue));
+    memcpy(getArgumentTypesBuffer(root) + compactStarts[layer] * typeSize,
+           getArgumentTypesBuffer(staged) + stagedStarts[layer] * typeSize,
+           sizes[layer] * typeSize);
+    if(formatFlags & WISENT_FORMAT_FLAG_NULL_BITMAP) {
+      copyNullBits(staged, stagedStarts[layer], root, compactStarts[layer], sizes[layer]);
     }
-    endExpression();
-    return true;
   }
+  for(uint64_t expressionIndex = 0; expressionIndex < expressionCount; ++expressionIndex) {
+    auto expression = getExpression(staged, expressionIndex);
+    auto layer = std::upper_bound(stagedStarts.begin(), stagedStarts.end(),
+                                  expression.startChildOffset) -
+                 stagedStarts.begin() - 1;
+    expression.startChildOffset += compactStarts[layer] - stagedStarts[layer];
+    expression.endChildOffset += compactStarts[layer] - stagedStarts[layer];
+    storeExpression(root, expressionIndex, expression);
+  }
+  memcpy(getStringBuffer(root), getStringBuffer(staged), stringBytes);
+  root->stringArgumentsFillIndex = stringBytes;
+  if(!sections.empty()) {
+    auto* bytes = reinterpret_cast<char*>(root);
+    memset(bytes + treeSize + stringBytes, 0, sectionsOffset - treeSize - stringBytes);
+    memcpy(bytes + sectionsOffset, sections.data(), sections.size());
+  }
+  return root;
+}
+
+/* the staging range of a single pass (none if the address space cannot be reserved, e.g. under
+ * vm.overcommit_memory=2 or an RLIMIT_AS) */
+static std::unique_ptr<ReservedMemoryRange> reserveStagingRange(LoadOptions const& options) {
+  try {
+    return std::make_unique<ReservedMemoryRange>(getStagingReservation(options));
+  } catch(std::runtime_error const&) {
+    return nullptr;
+  }
+}
+
+template <typename ParseFunc, typename Memory>
+static WisentRootExpression* loadSinglePass(ParseFunc&& parse, ReservedMemoryRange& staging,
+                                            Memory& memory, CsvCache& csvCache,
+                                            LoadOptions const& options) {
+  std::vector<uint64_t> argumentCountPerLayer(1 + singlePassMaxLayers, singlePassLayerCapacity);
+  argumentCountPerLayer[0] = 1; // root expression
+  std::vector<uint64_t> layerStarts(argumentCountPerLayer.size());
+  std::partial_sum(argumentCountPerLayer.begin(), argumentCountPerLayer.end(),
+                   layerStarts.begin());
+  // staged offsets span the whole reserved range: compact offsets only once compacted
+  JsonToWisent jsonToWisent(singlePassExpressionCapacity, std::move(argumentCountPerLayer), 0,
+                            staging, csvCache, options,
+                            getRequestedFormatFlags(options) & ~WISENT_FORMAT_FLAG_COMPACT_OFFSETS);
+  parse(jsonToWisent);
+  jsonToWisent.reserveStringSlack();
+  return compactLayers(jsonToWisent.getRoot(), layerStarts, jsonToWisent.getLayerEnds(),
+                       jsonToWisent.getExpressionCount(), getRequestedFormatFlags(options),
+                       jsonToWisent.getSections(), memory);
+}
+
+/* parallel mode: the chunks of a document split between its top-level elements */
+static size_t const minimumJsonChunkSize = size_t{1} << 20;
+
+struct JsonChunks {
+  char open = 0; // '[' or '{'
+  char close = 0;
+  std::vector<std::string_view> elements; // (each chunk's elements, with the commas between)
+  bool hasCsvFilenames = false;           // (strings ending with '.csv', as written)
 };
 
+/* scan the structure of a document for the commas between the top-level array/object's elements,
+ * cutting chunks of at least chunkSize bytes (none if the document is not an array/object, or
+ * is malformed: left to the parser to report) */
+static JsonChunks splitJsonDocument(std::string_view document, size_t chunkSize) {
+  auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+  size_t begin = std::find_if_not(document.begin(), document.end(), isSpace) - document.begin();
+  if(begin == document.size() || (document[begin] != '[' && document[begin] != '{')) {
+    return {};
+  }
+  JsonChunks chunks;
+  chunks.open = document[begin];
+  chunks.close = chunks.open == '[' ? ']' : '}';
+  auto chunkStart = begin + 1;
+  size_t depth = 1;
+  for(auto i = begin + 1; i < document.size(); ++i) {
+    switch(document[i]) {
+    case '"': {
+      // skip to the closing quote (the first one not escaped)
+      auto stringStart = i + 1;
+      for(;;) {
+        auto const* quote = static_cast<char const*>(
+            memchr(document.data() + i + 1, '"', document.size() - i - 1));
+        if(quote == nullptr) {
+          return {};
+        }
+        i = quote - document.data();
+        size_t backslashes = 0;
+        while(document[i - 1 - backslashes] == '\\') {
+          ++backslashes;
+        }
+        if(backslashes % 2 == 0) {
+          break;
+        }
+      }
+      if(i - stringStart >= 4 && document.compare(i - 4, 4, ".csv") == 0) {
+        chunks.hasCsvFilenames = true;
+      }
+      break;
+    }
+    case '[':
+    case '{':
+      ++depth;
+      break;
+    case ']':
+    case '}':
+      if(--depth > 0) {
+        break;
+      }
+      if(std::find_if_not(document.begin() + i + 1, document.end(), isSpace) != document.end()) {
+        return {};
+      }
+      chunks.elements.push_back(document.substr(chunkStart, i - chunkStart));
+      return chunks;
+    case ',':
+      if(depth == 1 && i - chunkStart >= chunkSize) {
+        chunks.elements.push_back(document.substr(chunkStart, i - chunkStart));
+        chunkStart = i + 1;
+      }
+      break;
+    }
+  }
+  return {};
+}
+
+/* serialize the chunks of a json document's top-level elements on parseThreads threads, each as
+ * a document of its own (in its own parser, both passes), then stitch their trees
+ * returns nullptr if the document is not split (to serialize it sequentially) */
+template <typename Memory>
+static WisentRootExpression* serializeChunks(std::string const& path, LoadOptions const& options,
+                                             Memory& memory) {
+  MappedFile input(path);
+  auto threadCount = getParseThreadCount(options);
+  auto split = splitJsonDocument(std::string_view(input.data(), input.size()),
+                                 std::max(minimumJsonChunkSize, input.size() / (4 * threadCount)));
+  if(split.elements.size() < 2 || (split.hasCsvFilenames && !options.disableCsvHandling)) {
+    return nullptr;
+  }
+  auto* progress = options.progress;
+  if(progress != nullptr) {
+    progress->enterPhase(LoadProgress::Phase::parsing);
+    progress->add(0, 2 * input.size());
+  }
+  auto getInputBytes = [&](size_t chunkIndex) { // (up to the next chunk)
+    auto start = chunkIndex == 0 ? input.data() : split.elements[chunkIndex].data();
+    auto end = chunkIndex + 1 == split.elements.size() ? input.data() + input.size()
+                                                       : split.elements[chunkIndex + 1].data();
+    return static_cast<uint64_t>(end - start);
+  };
+  // the sections are only built for the stitched tree
+  auto chunkOptions = options;
+  chunkOptions.disableCsvHandling = true;
+  chunkOptions.progress = nullptr;
+  std::string const csvPrefix;
+  CsvCache csvCache(csvPrefix, options.csvParser); // (not used)
+  struct Chunk {
+    simdjson::padded_string text; // the elements in a container, as a document
+    simdjson::dom::parser simdjsonParser;
+    simdjson::dom::element document;
+    std::optional<JsonArgumentCounter> counter;
+    std::vector<uint64_t> argumentCountPerLayer;
+  };
+  std::vector<Chunk> chunks(split.elements.size());
+  auto parse = [&](Chunk& chunk, auto& sax) {
+    if(options.parser == JsonParser::simdjson) {
+      saxParse(chunk.document, sax);
+      return;
+    }
+    json::sax_parse(chunk.text.data(), chunk.text.data() + chunk.text.size(), &sax);
+  };
+  parallelFor(chunks.size(), threadCount, [&](size_t chunkIndex) {
+    auto& chunk = chunks[chunkIndex];
+    auto elements = split.elements[chunkIndex];
+    chunk.text = simdjson::padded_string(elements.size() + 2);
+    chunk.text.data()[0] = split.open;
+    memcpy(chunk.text.data() + 1, elements.data(), elements.size());
+    chunk.text.data()[elements.size() + 1] = split.close;
+    if(options.parser == JsonParser::simdjson) {
+      auto error = chunk.simdjsonParser.parse(chunk.text).get(chunk.document);
+      if(error) {
+        throw std::runtime_error("failed to parse: " + path + " (" +
+                                 simdjson::error_message(error) + ")");
+      }
+    }
+    chunk.counter.emplace(csvCache, chunkOptions);
+    parse(chunk, *chunk.counter);
+    chunk.argumentCountPerLayer = chunk.counter->getArgumentCountPerLayer();
+    if(progress != nullptr) {
+      progress->add(getInputBytes(chunkIndex), 0);
+    }
+  });
+
+  // the stitched tree's size: the chunks' without their own top-level expression
+  std::string const head = split.open == '[' ? "List" : "Object";
+  std::vector<uint64_t> argumentCountPerLayer{1};
+  uint64_t expressionCount = 1;
+  uint64_t stringBytes = head.size() + 1;
+  for(auto const& chunk : chunks) {
+    auto const& counts = chunk.argumentCountPerLayer;
+    argumentCountPerLayer.resize(std::max(argumentCountPerLayer.size(), counts.size()), 0);
+    std::transform(counts.begin() + 1, counts.end(), argumentCountPerLayer.begin() + 1,
+                   argumentCountPerLayer.begin() + 1, std::plus<>());
+    expressionCount += chunk.counter->getExpressionCount() - 1;
+    stringBytes += chunk.counter->getStringBytes() - (head.size() + 1);
+  }
+
+  if(progress != nullptr) {
+    progress->enterPhase(LoadProgress::Phase::serializing);
+  }
+  auto chunkFormatFlags =
+      getRequestedFormatFlags(chunkOptions) & ~WISENT_FORMAT_FLAG_COMPACT_OFFSETS;
+  std::vector<std::unique_ptr<ReservedMemoryRange>> chunkMemories(chunks.size());
+  std::vector<std::unique_ptr<JsonToWisent<ReservedMemoryRange>>> chunkTrees(chunks.size());
+  parallelFor(chunks.size(), threadCount, [&](size_t chunkIndex) {
+    auto& chunk = chunks[chunkIndex];
+    auto argumentCount = std::accumulate(chunk.argumentCountPerLayer.begin(),
+                                         chunk.argumentCountPerLayer.end(), uint64_t{0});
+    auto expressionCount = chunk.counter->getExpressionCount();
+    auto stringBytes = chunk.counter->getStringBytes();
+    chunkMemories[chunkIndex] = std::make_unique<ReservedMemoryRange>(
+        getExpressionTreeSize(argumentCount, expressionCount, options.formatVersion,
+                              chunkFormatFlags) +
+        2 * stringBytes); // (room for the string buffer's growth)
+    chunkTrees[chunkIndex] = std::make_unique<JsonToWisent<ReservedMemoryRange>>(
+        expressionCount, std::vector<uint64_t>(chunk.argumentCountPerLayer), stringBytes,
+        *chunkMemories[chunkIndex], csvCache, chunkOptions, chunkFormatFlags);
+    parse(chunk, *chunkTrees[chunkIndex]);
+    chunk.text = simdjson::padded_string(); // (only the tree is needed now)
+    chunk.simdjsonParser = simdjson::dom::parser();
+    if(progress != nullptr) {
+      progress->add(getInputBytes(chunkIndex), 0);
+    }
+  });
+
+  JsonToWisent jsonToWisent(expressionCount, std::move(argumentCountPerLayer), stringBytes, memory,
+                            csvCache, options, getRequestedFormatFlags(options));
+  jsonToWisent.stitchChunks(head, chunkTrees, threadCount);
+  jsonToWisent.finish();
+  if(progress != nullptr) {
+    progress->finishPhase();
+  }
+  return jsonToWisent.getRoot();
+}
 WisentRootExpression* wisent::serializer::load(std::string const& path,
                                                std::string const& sharedMemoryName,
                                                std::string const& csvPrefix, bool disableRLE,
                                                bool disableCsvHandling, bool forceReload) {
-  auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
-  if(!forceReload && sharedMemory.exists() && !sharedMemory.loaded()) {
-    sharedMemory.load();
-  }
-  if(sharedMemory.loaded()) {
-    if(!forceReload) {
-      return reinterpret_cast<WisentRootExpression*>(sharedMemory.baseAddress());
-    }
-    free(sharedMemoryName);
-  }
-  setCurrentSharedMemory(sharedMemory);
-
-  std::ifstream ifs(path);
-  if(!ifs.good()) {
-    throw std::runtime_error("failed to read: " + path);
-  }
-  // 1st traversal just to calculate the total size needed
-  uint64_t expressionCount = 0;
-  std::vector<uint64_t> argumentCountPerLayer;
-  argumentCountPerLayer.reserve(16);
-  json::parse(ifs, [&csvPrefix, &disableCsvHandling, &expressionCount, &argumentCountPerLayer,
-                    layerIndex = uint64_t{0}, wasKeyValue = std::vector<bool>(16)](
-                       int depth, json::parse_event_t event, json& parsed) mutable {
-    if(wasKeyValue.size() <= depth) {
-      wasKeyValue.resize(wasKeyValue.size() * 2, false);
-    }
-    if(argumentCountPerLayer.size() <= layerIndex) {
-      argumentCountPerLayer.resize(layerIndex + 1, 0);
-    }
-    if(event == json::parse_event_t::key) {
-      argumentCountPerLayer[layerIndex]++;
-      expressionCount++;
-      wasKeyValue[depth] = true;
-      layerIndex++;
-      return true;
-    }
-    if(event == json::parse_event_t::object_start || event == json::parse_event_t::array_start) {
-      argumentCountPerLayer[layerIndex]++;
-      expressionCount++;
-      layerIndex++;
-      return true;
-    }
-    if(event == json::parse_event_t::object_end || event == json::parse_event_t::array_end) {
-      layerIndex--;
-      if(wasKeyValue[depth]) {
-        wasKeyValue[depth] = false;
-        layerIndex--;
-      }
-      return true;
-    }
-    if(event == json::parse_event_t::value) {
-      argumentCountPerLayer[layerIndex]++;
-      if(!disableCsvHandling && parsed.is_string()) {
-        auto filename = parsed.get<std::string>();
-        auto extPos = filename.find_last_of(".");
-        if(extPos != std::string::npos && filename.substr(extPos) == ".csv") {
-          auto doc = openCsvFile(csvPrefix + filename);
-          auto rows = doc.GetRowCount();
-          auto cols = doc.GetColumnCount();
-          static const size_t numTableLayers = 2; // Column/Data
-          if(argumentCountPerLayer.size() <= layerIndex + numTableLayers) {
-            argumentCountPerLayer.resize(layerIndex + numTableLayers + 1, 0);
-          }
-          expressionCount++;                             // Table expression
-          argumentCountPerLayer[layerIndex + 1] += cols; // Column expressions
-          expressionCount += cols;
-          argumentCountPerLayer[layerIndex + 2] += cols * rows; // Column data
-        }
+  LoadOptions options;
+  options.disableRLE = disableRLE;
+  options.disableCsvHandling = disableCsvHandling;
+  options.forceReload = forceReload;
+  return load(path, sharedMemoryName, csvPrefix, options);
+}
+
+/* serialize a JSON document (and its CSV files) into a tree allocated in memory */
+template <typename Memory>
+static WisentRootExpression* serialize(std::string const& path, std::string const& csvPrefix,
+                                       LoadOptions const& options, Memory& memory) {
+  std::unique_ptr<ReservedMemoryRange> staging;
+  if(options.singlePass && !(staging = reserveStagingRange(options))) {
+    auto twoPassOptions = options; // (without the address space to stage the layers)
+    twoPassOptions.singlePass = false;
+    return serialize(path, csvPrefix, twoPassOptions, memory);
+  }
+  if(getParseThreadCount(options) > 1 && !options.singlePass && !options.internStrings) {
+    if(auto* root = serializeChunks(path, options, memory)) {
+      return root;
+    }
+  }
+  // simdjson parses the whole (memory-mapped) document once, both passes walk the same DOM
+  std::unique_ptr<MappedFile> input;
+  simdjson::dom::parser simdjsonParser;
+  simdjson::dom::element document;
+  if(options.parser == JsonParser::simdjson) {
+    input = std::make_unique<MappedFile>(path);
+    auto error = simdjsonParser
+                     .parse(reinterpret_cast<uint8_t const*>(input->data()), input->size(),
+                            !input->isPaddedBy(simdjson::SIMDJSON_PADDING))
+                     .get(document);
+    if(error) {
+      throw std::runtime_error("failed to parse: " + path + " (" +
+                               simdjson::error_message(error) + ")");
+    }
+  }
+  auto parse = [&](auto& sax) {
+    if(options.parser == JsonParser::simdjson) {
+      saxParse(document, sax);
+      return;
+    }
+    std::ifstream ifs(path);
+    if(!ifs.good()) {
+      throw std::runtime_error("failed to read: " + path);
+    }
+    json::sax_parse(ifs, &sax);
+  };
+
+  std::error_code error;
+  auto documentSize = std::filesystem::file_size(path, error);
+  documentSize = error ? 0 : documentSize;
+  auto* progress = options.progress;
+  auto setPhase = [progress, documentSize](LoadProgress::Phase phase, uint64_t passes) {
+    if(progress != nullptr) {
+      progress->enterPhase(phase);
+      progress->add(0, passes * documentSize);
+    }
+  };
+  auto documentParsed = [progress, documentSize]() {
+    if(progress != nullptr) {
+      progress->add(documentSize, 0);
+    }
+  };
+
+  CsvCache csvCache(csvPrefix, options.csvParser, progress);
+  if(options.singlePass) {
+    setPhase(LoadProgress::Phase::serializing, 1);
+    auto* root = loadSinglePass(parse, *staging, memory, csvCache, options);
+    documentParsed();
+    if(progress != nullptr) {
+      progress->finishPhase();
+    }
+    return root;
+  }
+  setPhase(LoadProgress::Phase::parsing, 2);
+  JsonArgumentCounter counter(csvCache, options);
+  parse(counter);
+  documentParsed();
+  setPhase(LoadProgress::Phase::serializing, 0);
+  JsonToWisent jsonToWisent(counter.getExpressionCount(), counter.getArgumentCountPerLayer(),
+                            counter.getStringBytes(), memory, csvCache, options,
+                            getRequestedFormatFlags(options));
+  parse(jsonToWisent);
+  documentParsed();
+  jsonToWisent.finish();
+  if(progress != nullptr) {
+    progress->finishPhase();
+  }
+  return jsonToWisent.getRoot();
+}
+
+/* whether a loaded tree has the format the options request (a tree kept for a warm restart may
+ * have been serialized with other options) */
+static bool hasRequestedFormat(WisentRootExpression* root, LoadOptions const& options) {
+  return getFormatVersion(root) == options.formatVersion &&
+         getFormatFlags(root) == getRequestedFormatFlags(options);
+}
+
+WisentRootExpression* wisent::serializer::load(std::string const& path,
+                                               std::string const& sharedMemoryName,
+                                               std::string const& csvPrefix,
+                                               LoadOptions const& options) {
+  auto build = [&](SharedMemorySegment& next) { serialize(path, csvPrefix, options, next); };
+  auto* root = static_cast<WisentRootExpression*>(
+      loadOrBuildMemorySegment(sharedMemoryName, options.forceReload, build));
+  if(!hasRequestedFormat(root, options)) {
+    root = static_cast<WisentRootExpression*>(
+        loadOrBuildMemorySegment(sharedMemoryName, true, build));
+  }
+  return root;
+}
+
+/* as loadOrBuildMemorySegment, for a tree of an arena: a new generation is built beside it
+ * ('[treeName].next'), then the two swap their names (the arena's trees are locked by name as
+ * the segments) */
+template <typename Build>
+static WisentRootExpression* loadOrBuildArenaTree(SegmentArena& arena, std::string const& treeName,
+                                                  bool rebuild, Build&& build) {
+  auto current = [&arena, &treeName]() {
+    auto lock = lockMemorySegment(treeName);
+    return static_cast<WisentRootExpression*>(arena.find(treeName));
+  };
+  auto* root = rebuild ? nullptr : current();
+  if(root != nullptr) {
+    return root;
+  }
+  auto nextName = treeName + ".next";
+  auto buildLock = lockMemorySegment(nextName);
+  root = rebuild ? nullptr : current(); // (built by a concurrent load meanwhile)
+  if(root != nullptr) {
+    return root;
+  }
+  // (replaced by the previous rebuild, or left by an interrupted one; throws while it is read)
+  arena.release(nextName);
+  try {
+    SegmentArena::Allocation next(arena, nextName);
+    build(next);
+  } catch(...) {
+    arena.release(nextName);
+    throw;
+  }
+  auto lock = lockMemorySegment(treeName);
+  arena.swapNames(nextName, treeName);
+  return static_cast<WisentRootExpression*>(arena.find(treeName));
+}
+
+WisentRootExpression* wisent::serializer::load(std::string const& path, SegmentArena& arena,
+                                               std::string const& treeName,
+                                               std::string const& csvPrefix,
+                                               LoadOptions const& options) {
+  auto build = [&](SegmentArena::Allocation& next) { serialize(path, csvPrefix, options, next); };
+  auto* root = loadOrBuildArenaTree(arena, treeName, options.forceReload, build);
+  if(!hasRequestedFormat(root, options)) {
+    root = loadOrBuildArenaTree(arena, treeName, true, build);
+  }
+  return root;
+}
+
+WisentRootExpression* wisent::serializer::load(std::string const& path,
+                                               ReservedMemoryRange& memory,
+                                               std::string const& csvPrefix,
+                                               LoadOptions const& options) {
+  return serialize(path, csvPrefix, options, memory);
+}
+
+/* clear the null bits of an argument range (left by an append that was not published) */
+static void clearNullBits(WisentRootExpression* root, uint64_t begin, uint64_t end) {
+  if(!(getFormatFlags(root) & WISENT_FORMAT_FLAG_NULL_BITMAP)) {
+    return;
+  }
+  auto* words = getNullBitmap(root);
+  for(auto i = begin; i < end;) {
+    auto bits = std::min<uint64_t>(64 - i % 64, end - i);
+    auto mask = (bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1) << (i % 64);
+    __atomic_fetch_and(&words[i / 64], ~mask, __ATOMIC_RELAXED); // (shared with other columns)
+    i += bits;
+  }
+}
+
+/* publish the new end of an expression's arguments with a release store */
+static void publishExpressionEnd(WisentRootExpression* root, uint64_t expressionIndex,
+                                 uint64_t end) {
+  if(getFormatFlags(root) & WISENT_FORMAT_FLAG_COMPACT_OFFSETS) {
+    auto* compact =
+        reinterpret_cast<WisentCompactExpression*>(getExpressionsBuffer(root)) + expressionIndex;
+    __atomic_store_n(&compact->endChildOffset, static_cast<uint32_t>(end), __ATOMIC_RELEASE);
+    return;
+  }
+  __atomic_store_n(&getExpressionSubexpressions(root)[expressionIndex].endChildOffset, end,
+                   __ATOMIC_RELEASE);
+}
+
+/* append the rows of a csv file to a Table in place: fill the slack of its columns and of the
+ * string buffer, then publish the rows (see WisentColumnCapacities). Returns false, publishing
+ * nothing, if the new strings (stringBytes) do not fit in the string slack. The caller prevents
+ * concurrent appends to the tree. */
+static bool appendRows(WisentRootExpression* root, std::string const& tablePath,
+                       std::string const& csvFilepath, CsvCache::Table const& table,
+                       LoadOptions const& options, uint64_t& stringBytes) {
+  wisent::path::CompiledPath const compiledTablePath(tablePath);
+  auto const& tableArguments = compiledTablePath.resolve(root, 0); // (resolved once)
+  if(tableArguments.size() != 1 ||
+     (getArgumentType(root, tableArguments[0]) & ~WisentArgumentType_RLE_BIT) !=
+         WisentArgumentType::ARGUMENT_TYPE_EXPRESSION) {
+    throw std::runtime_error("no Table at: " + tablePath);
+  }
+  auto tableExpression =
+      getExpression(root, getExpressionArguments(root)[tableArguments[0]].asExpression);
+  if(std::string_view(viewString(root, tableExpression.symbolNameOffset)) != "Table") {
+    throw std::runtime_error("not a Table at: " + tablePath);
+  }
+
+  // the Table's columns as loaded: the projected ones record their csv column with their slack,
+  // the others are empty placeholders at the position of theirs
+  auto* capacities = static_cast<WisentColumnCapacities*>(
+      findSection(root, WISENT_SECTION_COLUMN_CAPACITIES));
+  if(capacities == nullptr) {
+    throw std::runtime_error("no slack reserved for appending to: " + tablePath +
+                             " (see tableSlack)");
+  }
+  std::vector<uint64_t> columnExpressions; // (of the projected columns)
+  std::vector<size_t> csvColumns;
+  for(auto argIndex = tableExpression.startChildOffset; argIndex < tableExpression.endChildOffset;
+      ++argIndex) {
+    auto expressionIndex = getExpressionArguments(root)[argIndex].asExpression;
+    auto expression = getExpression(root, expressionIndex);
+    auto columnName = viewString(root, expression.symbolNameOffset);
+    auto const* capacity = getColumnCapacity(root, expressionIndex);
+    auto csvColumn =
+        capacity != nullptr ? capacity->csvColumn : argIndex - tableExpression.startChildOffset;
+    if(csvColumn >= table.columnNames.size() || table.columnNames[csvColumn] != columnName) {
+      throw std::runtime_error("the columns of " + csvFilepath + " do not match the Table at " +
+                               tablePath);
+    }
+    if(capacity == nullptr) {
+      if(expression.endChildOffset != expression.startChildOffset) {
+        throw std::runtime_error("no slack reserved for appending to: " +
+                                 std::string(columnName) + " (see tableSlack)");
       }
-      if(wasKeyValue[depth]) {
-        wasKeyValue[depth] = false;
-        layerIndex--;
+      continue; // (a placeholder)
+    }
+    if(expression.endChildOffset - expression.startChildOffset + table.rowCount >
+       capacity->capacity) {
+      throw std::runtime_error("not enough slack left to append " +
+                               std::to_string(table.rowCount) + " rows to: " +
+                               std::string(columnName));
+    }
+    if((getFormatFlags(root) & WISENT_FORMAT_FLAG_COMPACT_OFFSETS) &&
+       expression.startChildOffset + capacity->capacity > std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error("offsets exceed 32 bits: cannot use the compact offsets format");
+    }
+    columnExpressions.push_back(expressionIndex);
+    csvColumns.push_back(csvColumn);
+  }
+
+  if(columnExpressions.empty()) {
+    return true; // (only placeholders)
+  }
+
+  auto* zoneMaps = getZoneMaps(root);
+  auto columnCount = columnExpressions.size();
+  std::vector<ColumnStrings> strings(columnCount);
+  std::vector<ZoneMapUpdate> zoneMapUpdates(columnCount);
+  parallelFor(columnCount, getCsvThreadCount(options), [&](size_t columnIndex) {
+    auto expression = getExpression(root, columnExpressions[columnIndex]);
+    auto oldEnd = expression.endChildOffset;
+    auto end = oldEnd + table.rowCount;
+    clearNullBits(root, oldEnd, end);
+    if(table.rowCount > 0) {
+      convertCsvColumn(root, table, csvColumns[columnIndex], oldEnd, strings[columnIndex]);
+    }
+    if(auto* column = zoneMaps != nullptr ? getColumnStats(root, columnExpressions[columnIndex])
+                                          : nullptr) {
+      zoneMapUpdates[columnIndex] = computeZoneMapUpdate(
+          root, expression.startChildOffset, oldEnd, end, zoneMaps->blockSize, column);
+    }
+    if(!options.disableRLE) {
+      encodeTypeRuns(root, oldEnd, end); // (new runs: the published ones are left as they are)
+    }
+  });
+
+  // the new strings go in the string slack
+  stringBytes = 0;
+  for(auto const& columnStrings : strings) {
+    stringBytes += columnStrings.buffer.size();
+  }
+  if(capacities->stringSlackStart + stringBytes > root->stringArgumentsFillIndex) {
+    return false;
+  }
+  for(auto const& columnStrings : strings) {
+    auto baseOffset = capacities->stringSlackStart;
+    memcpy(getStringBuffer(root) + baseOffset, columnStrings.buffer.data(),
+           columnStrings.buffer.size());
+    capacities->stringSlackStart += columnStrings.buffer.size();
+    for(auto argIndex : columnStrings.argumentIndices) {
+      getExpressionArguments(root)[argIndex].asString += baseOffset;
+    }
+  }
+
+  // publish the rows: the zone maps change with the column ends
+  __atomic_store_n(&capacities->sequence, capacities->sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for(auto const& update : zoneMapUpdates) {
+    if(update.column != nullptr) {
+      std::copy(update.blocks.begin(), update.blocks.end(),
+                getBlockStats(root, update.column) + update.firstBlock);
+      *update.column = update.stats;
+    }
+  }
+  for(auto expressionIndex : columnExpressions) {
+    publishExpressionEnd(root, expressionIndex,
+                         getExpression(root, expressionIndex).endChildOffset + table.rowCount);
+  }
+  __atomic_store_n(&capacities->sequence, capacities->sequence + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* a copy of a tree in memory, with extraBytes more (zero) bytes of string slack */
+template <typename Memory>
+static WisentRootExpression* copyTreeWithStringSlack(WisentRootExpression* tree,
+                                                     uint64_t extraBytes, Memory& memory) {
+  auto stringBufferEnd = getStringBufferOffset(tree) + tree->stringArgumentsFillIndex;
+  auto sectionsSize = getSectionsSize(tree);
+  auto sectionsOffset = (stringBufferEnd + extraBytes + 7) & ~uint64_t{7};
+  auto* copy = static_cast<char*>(memory.malloc(sectionsOffset + sectionsSize));
+  memcpy(copy, tree, stringBufferEnd);
+  memset(copy + stringBufferEnd, 0, sectionsOffset - stringBufferEnd);
+  memcpy(copy + sectionsOffset, reinterpret_cast<char*>(tree) + getSectionsOffset(tree),
+         sectionsSize);
+  auto* root = reinterpret_cast<WisentRootExpression*>(copy);
+  root->stringArgumentsFillIndex += extraBytes;
+  return root;
+}
+
+WisentRootExpression* wisent::serializer::append(std::string const& sharedMemoryName,
+                                                 std::string const& tablePath,
+                                                 std::string const& csvFilepath,
+                                                 LoadOptions const& options) {
+  auto appendLock = lockMemorySegment(sharedMemoryName + ".append"); // (one append at a time)
+  std::string const csvPrefix;
+  CsvCache csvCache(csvPrefix, options.csvParser);
+  auto const& table = csvCache.get(csvFilepath);
+  auto current = [&sharedMemoryName]() {
+    auto& segment = createOrGetMemorySegment(sharedMemoryName);
+    if(!segment.loaded()) {
+      if(!segment.exists()) {
+        throw std::runtime_error("no dataset loaded in: " + sharedMemoryName);
       }
-      return true;
+      segment.load();
+    }
+    return static_cast<WisentRootExpression*>(segment.baseAddress());
+  };
+  uint64_t stringBytes = 0;
+  {
+    auto lock = lockMemorySegment(sharedMemoryName);
+    auto* root = current();
+    if(appendRows(root, tablePath, csvFilepath, table, options, stringBytes)) {
+      return root;
+    }
+  }
+  // the strings need more slack: a new generation (published as a reload) with twice their size
+  return static_cast<WisentRootExpression*>(
+      loadOrBuildMemorySegment(sharedMemoryName, true, [&](SharedMemorySegment& next) {
+        WisentRootExpression* root = nullptr;
+        {
+          auto lock = lockMemorySegment(sharedMemoryName);
+          root = copyTreeWithStringSlack(current(), 2 * stringBytes, next);
+        }
+        if(!appendRows(root, tablePath, csvFilepath, table, options, stringBytes)) {
+          throw std::runtime_error("no string slack left to append: " + csvFilepath);
+        }
+      }));
+}
+
+WisentRootExpression* wisent::serializer::append(SegmentArena& arena, std::string const& treeName,
+                                                 std::string const& tablePath,
+                                                 std::string const& csvFilepath,
+                                                 LoadOptions const& options) {
+  auto appendLock = lockMemorySegment(treeName + ".append"); // (one append at a time)
+  std::string const csvPrefix;
+  CsvCache csvCache(csvPrefix, options.csvParser);
+  auto const& table = csvCache.get(csvFilepath);
+  auto current = [&arena, &treeName]() {
+    auto* root = static_cast<WisentRootExpression*>(arena.find(treeName));
+    if(root == nullptr) {
+      throw std::runtime_error("no dataset loaded in the arena: " + treeName);
+    }
+    return root;
+  };
+  uint64_t stringBytes = 0;
+  {
+    auto lock = lockMemorySegment(treeName);
+    auto* root = current();
+    if(appendRows(root, tablePath, csvFilepath, table, options, stringBytes)) {
+      return root;
+    }
+  }
+  return loadOrBuildArenaTree(arena, treeName, true, [&](SegmentArena::Allocation& next) {
+    WisentRootExpression* root = nullptr;
+    {
+      auto lock = lockMemorySegment(treeName);
+      root = copyTreeWithStringSlack(current(), 2 * stringBytes, next);
+    }
+    if(!appendRows(root, tablePath, csvFilepath, table, options, stringBytes)) {
+      throw std::runtime_error("no string slack left to append: " + csvFilepath);
     }
   });
-  JsonToWisent jsonToWisent(expressionCount, std::move(argumentCountPerLayer), sharedMemory,
-                            csvPrefix, disableRLE, disableCsvHandling);
-  ifs.seekg(0);
-  json::sax_parse(ifs, &jsonToWisent);
-  ifs.close();
-  return jsonToWisent.getRoot();
 }
 
 void wisent::serializer::unload(std::string const& sharedMemoryName) {
+  auto lock = lockMemorySegment(sharedMemoryName);
   auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
   assert(sharedMemory.loaded());
   sharedMemory.unload();
 }
 
 void wisent::serializer::free(std::string const& sharedMemoryName) {
-  auto& sharedMemory = createOrGetMemorySegment(sharedMemoryName);
-  sharedMemory.erase();
-  sharedMemorySegments().erase(sharedMemoryName);
+  auto lock = lockMemorySegment(sharedMemoryName);
+  freeMemorySegment(sharedMemoryName);
+}
+
+void wisent::serializer::free(SegmentArena& arena, std::string const& treeName) {
+  auto nextName = treeName + ".next";
+  auto buildLock = lockMemorySegment(nextName);
+  auto lock = lockMemorySegment(treeName);
+  arena.release(nextName);
+  arena.release(treeName);
+}
+
+wisent::serializer::TreeComposition wisent::serializer::getComposition(WisentRootExpression* root) {
+  TreeComposition composition;
+  composition.headerBytes = offsetof(WisentRootExpression, arguments);
+  composition.argumentBytes = root->argumentCount * sizeof(WisentArgumentValue);
+  composition.typeBytes = getArgumentTypesBufferSize(root->argumentCount, getFormatVersion(root));
+  composition.nullBitmapBytes = getNullBitmapSize(root->argumentCount, getFormatFlags(root));
+  composition.structureBytes =
+      getExpressionsBufferSize(root->expressionCount, getFormatFlags(root));
+  composition.stringBytes = root->stringArgumentsFillIndex;
+  if((getFormatFlags(root) & WISENT_FORMAT_FLAG_SECTIONS) != 0) {
+    auto sectionsOffset = getSectionsOffset(root);
+    auto const* section = reinterpret_cast<WisentSectionHeader const*>(
+        reinterpret_cast<char const*>(root) + sectionsOffset);
+    for(; section->kind != WISENT_SECTION_END;
+        section = reinterpret_cast<WisentSectionHeader const*>(
+            reinterpret_cast<char const*>(section + 1) + section->size)) {
+      composition.sectionBytes += sizeof(WisentSectionHeader) + section->size;
+    }
+    composition.sectionBytes += sizeof(WisentSectionHeader); // (the end of the chain)
+    // (and the padding after the strings)
+    composition.sectionBytes += sectionsOffset - getStringBufferOffset(root) -
+                                root->stringArgumentsFillIndex;
+  }
+  for(uint64_t argumentI = 0; argumentI < root->argumentCount;) {
+    auto runEnd = getArgumentRunEnd(root, argumentI);
+    if((getArgumentType(root, argumentI) & WisentArgumentType_RLE_BIT) != 0) {
+      ++composition.rleRuns;
+      composition.rleArguments += runEnd - argumentI;
+    }
+    ++composition.typeRuns;
+    argumentI = runEnd;
+  }
+  return composition;
+}
+
+std::vector<std::string> wisent::serializer::splitPatterns(std::string const& list) {
+  std::vector<std::string> patterns;
+  for(size_t start = 0; start <= list.size();) {
+    auto end = std::min(list.find(',', start), list.size());
+    if(end > start) {
+      patterns.push_back(list.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return patterns;
+}
+
+bool wisent::serializer::parseLoadOption(int argc, char** argv, int& i, LoadOptions& options) {
+  std::string const flag = argv[i];
+  auto value = [&]() -> char const* {
+    if(i + 1 >= argc) {
+      throw std::runtime_error("missing the value of " + flag);
+    }
+    return argv[++i];
+  };
+  if(flag == "--disable-rle") {
+    options.disableRLE = true;
+  } else if(flag == "--disable-csv-handling") {
+    options.disableCsvHandling = true;
+  } else if(flag == "--intern-strings") {
+    options.internStrings = true;
+  } else if(flag == "--single-pass") {
+    options.singlePass = true;
+  } else if(flag == "--parser=simdjson") {
+    options.parser = JsonParser::simdjson;
+  } else if(flag == "--parser=nlohmann") {
+    options.parser = JsonParser::nlohmann;
+  } else if(flag == "--csv-parser=native") {
+    options.csvParser = CsvParser::native;
+  } else if(flag == "--csv-parser=rapidcsv") {
+    options.csvParser = CsvParser::rapidcsv;
+  } else if(flag == "--format-version") {
+    options.formatVersion = atoi(value());
+  } else if(flag == "--compact-offsets") {
+    options.compactOffsets = true;
+  } else if(flag == "--null-bitmap") {
+    options.nullBitmap = true;
+  } else if(flag == "--native-booleans") {
+    options.nativeBooleans = true;
+  } else if(flag == "--zone-map-block-size") {
+    options.zoneMapBlockSize = atoll(value());
+  } else if(flag == "--key-index-min-keys") {
+    options.keyIndexMinimumKeys = atoll(value());
+  } else if(flag == "--table-slack") {
+    options.tableSlack = atof(value());
+  } else if(flag == "--columns") {
+    for(auto& pattern : splitPatterns(value())) {
+      options.columns.patterns.push_back(std::move(pattern));
+    }
+  } else if(flag == "--column-placeholders") {
+    options.columns.placeholders = true;
+  } else if(flag == "--csv-threads") {
+    options.csvThreads = atoi(value());
+  } else if(flag == "--parse-threads") {
+    options.parseThreads = atoi(value());
+  } else {
+    return false;
+  }
+  return true;
+}
+
+uint64_t wisent::serializer::getStagingReservation(LoadOptions const& options) {
+  if(!options.singlePass) {
+    return 0;
+  }
+  return getExpressionTreeSize(1 + singlePassMaxLayers * singlePassLayerCapacity,
+                               singlePassExpressionCapacity, options.formatVersion,
+                               WISENT_FORMAT_FLAG_NULL_BITMAP) +
+         singlePassStringCapacity;
 }
 
 extern "C" {
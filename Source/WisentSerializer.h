@@ -1,8 +1,24 @@
 #ifndef WISENTSERIALIZER_H
 #define WISENTSERIALIZER_H
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 char* wisentLoad(char const* path, char const* sharedMemoryName, char const* csvPrefix);
 void wisentUnload(char const* sharedMemoryName);
 void wisentFree(char const* sharedMemoryName);
 
+/* compiled paths (see WisentPath.hpp): NULL if the path is invalid */
+void* wisentCompilePath(char const* path);
+/* the number of matching arguments, with their indices in *argumentIndices (valid until the path
+ * is resolved for another tree or generation, e.g. the dataset's generation in the catalog) */
+uint64_t wisentResolvePath(void* compiledPath, char* root, uint64_t generation,
+                           uint64_t const** argumentIndices);
+void wisentFreePath(void* compiledPath);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* WISENTSERIALIZER_H */
@@ -1,11 +1,136 @@
 #include "WisentHelpers.h"
+#include <atomic>
+#include <chrono>
 #include <string>
+#include <vector>
+class ReservedMemoryRange;
+class SegmentArena;
 namespace wisent {
 namespace serializer {
+enum class JsonParser { nlohmann, simdjson };
+enum class CsvParser { rapidcsv, native };
+
+/* progress of a load, updated by the loading thread (readable from other threads)
+ * each pass processes the input once: the json document, then each csv file is counted when
+ * parsed and when converted; the total grows as the csv files are found */
+struct LoadProgress {
+  enum class Phase { queued, parsing, serializing, finished, failed };
+  std::atomic<Phase> phase{Phase::queued};
+  std::atomic<uint64_t> bytesProcessed{0};
+  std::atomic<uint64_t> bytesTotal{0};
+  std::atomic<uint64_t> parsingNanoseconds{0}; // (the single pass is only serializing)
+  std::atomic<uint64_t> serializingNanoseconds{0};
+  std::chrono::steady_clock::time_point phaseStart; // (loading thread only)
+
+  void add(uint64_t processed, uint64_t total) {
+    bytesTotal += total;
+    bytesProcessed += processed;
+  }
+
+  /* (loading thread) account the time spent in the current phase, then enter the next one */
+  void enterPhase(Phase next) {
+    finishPhase();
+    phase = next;
+  }
+  void finishPhase() {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - phaseStart).count();
+    if(phase == Phase::parsing) {
+      parsingNanoseconds += elapsed;
+    } else if(phase == Phase::serializing) {
+      serializingNanoseconds += elapsed;
+    }
+    phaseStart = now;
+  }
+};
+
+/* the csv columns to convert: fnmatch() globs of column names, each optionally qualified by a
+ * glob of the csv file as referenced in the json document ('[file glob]:[column glob]')
+ * a file keeps all its columns if no pattern applies to it */
+struct ColumnProjection {
+  std::vector<std::string> patterns; // (none: all the columns)
+  bool placeholders = false; // the other columns as empty column expressions (else skipped)
+};
+
+struct LoadOptions {
+  bool disableRLE = false;
+  bool disableCsvHandling = false;
+  bool forceReload = false;
+  bool internStrings = false; // store each distinct string/symbol only once in the string buffer
+  bool singlePass = false;    // parse once into a reserved address range, then compact the layers
+  JsonParser parser = JsonParser::nlohmann;
+  CsvParser csvParser = CsvParser::rapidcsv;
+  uint32_t formatVersion = WISENT_FORMAT_VERSION_1; // 2: 1-byte argument types
+  bool compactOffsets = false; // (format version 2) 32-bit expression offsets, for under 4 GB
+  bool nullBitmap = false;     // missing csv values and json nulls as nulls in a bitmap
+  bool nativeBooleans = false; // json true/false as ARGUMENT_TYPE_BOOL instead of symbols
+  unsigned csvThreads = 0; // threads converting the columns of a table (0: one per core)
+  /* threads serializing chunks of the top-level array/object's elements of a json document,
+   * stitched afterwards (0: one per core, 1: sequential)
+   * (documents referencing csv files, internStrings and singlePass are serialized sequentially) */
+  unsigned parseThreads = 1;
+  uint64_t zoneMapBlockSize = 0; // rows per block of the numeric csv column stats (0: none)
+  uint64_t keyIndexMinimumKeys = 0; // hash the keys of expressions with this many (0: none)
+  double tableSlack = 0; // empty rows reserved per csv column for append(), as a fraction
+  ColumnProjection columns; // (csv files) the columns to convert, counted by the 1st pass
+  LoadProgress* progress = nullptr; // (optional) updated while loading
+};
+WisentRootExpression* load(std::string const& path, std::string const& sharedMemoryName,
+                           std::string const& csvPrefix, LoadOptions const& options);
+/* load into a named allocation of an arena holding several trees (see SegmentArena)
+ * a reload builds the tree beside the current one ('[treeName].next'), then swaps their names:
+ * the replaced tree is kept as '[treeName].next' until the next reload (or free()), which throws
+ * while readers still hold it (see acquireArenaEntry()) */
+WisentRootExpression* load(std::string const& path, SegmentArena& arena,
+                           std::string const& treeName, std::string const& csvPrefix,
+                           LoadOptions const& options);
+/* serialize into a private address range instead of a segment (e.g. to write a '.wisent' file):
+ * the tree takes memory.size() bytes */
+WisentRootExpression* load(std::string const& path, ReservedMemoryRange& memory,
+                           std::string const& csvPrefix, LoadOptions const& options);
 WisentRootExpression* load(std::string const& path, std::string const& sharedMemoryName,
                            std::string const& csvPrefix, bool disableRLE = false,
                            bool disableCsvHandling = false, bool forceReload = false);
+/* append the rows of a csv file (with the same header) to a loaded Table, in place: the rows
+ * fill the slack reserved by LoadOptions::tableSlack (throws if exhausted), then are published
+ * (see WisentColumnCapacities); only when the new strings exceed the string slack, the tree is
+ * copied with more as a new generation published as a reload (the Table's columns are matched
+ * with the csv columns the load projected them from, recorded with their slack) */
+WisentRootExpression* append(std::string const& sharedMemoryName, std::string const& tablePath,
+                             std::string const& csvFilepath, LoadOptions const& options);
+WisentRootExpression* append(SegmentArena& arena, std::string const& treeName,
+                             std::string const& tablePath, std::string const& csvFilepath,
+                             LoadOptions const& options);
 void unload(std::string const& sharedMemoryName);
 void free(std::string const& sharedMemoryName);
+void free(SegmentArena& arena, std::string const& treeName); // (and its replaced generation)
+
+/* the bytes of each buffer of a tree, and the runs of its argument types */
+struct TreeComposition {
+  uint64_t headerBytes = 0;
+  uint64_t argumentBytes = 0;
+  uint64_t typeBytes = 0;
+  uint64_t nullBitmapBytes = 0;
+  uint64_t structureBytes = 0; // (the expressions)
+  uint64_t stringBytes = 0;
+  uint64_t sectionBytes = 0; // (zone maps, key index, column capacities)
+  uint64_t rleRuns = 0;
+  uint64_t rleArguments = 0; // (in the RLE runs)
+  uint64_t typeRuns = 0;     // the types a reader decodes: an RLE run or a single argument each
+
+  uint64_t totalBytes() const {
+    return headerBytes + argumentBytes + typeBytes + nullBitmapBytes + structureBytes +
+           stringBytes + sectionBytes;
+  }
+};
+TreeComposition getComposition(WisentRootExpression* root); // (scans the types)
+
+/* the patterns of a comma-separated list (e.g. of --columns) */
+std::vector<std::string> splitPatterns(std::string const& list);
+/* parse argv[i] into the options if it is a serialization flag of the tools (advancing i past
+ * its value, throws if it is missing): false if it is not one */
+bool parseLoadOption(int argc, char** argv, int& i, LoadOptions& options);
+/* the address space a load reserves besides its memory (the staging range of singlePass) */
+uint64_t getStagingReservation(LoadOptions const& options);
 } // namespace serializer
 } // namespace wisent
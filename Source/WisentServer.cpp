@@ -1,32 +1,80 @@
 #include "BsonSerializer.hpp"
+#include "ControlChannel.hpp"
 #include "CsvLoading.hpp"
+#include "SegmentArena.hpp"
+#include "SharedMemorySegment.hpp"
+#include "WisentCatalog.h"
 #include "WisentSerializer.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cctype>
 #include <cpp-httplib/httplib.h>
+#include <exception>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 int main(int argc, char** argv) {
   int httpPort = 3000;
   bool forceReload = false;
-  bool disableRLE = false;
-  bool disableCsvHandling = false;
+  wisent::serializer::LoadOptions defaults; // (the serialization flags of the loads)
+  std::string arenaName;
+  std::string controlSocketPath;
+  unsigned loadThreads = 1; // (each load converts its csv files with --csv-threads)
+  unsigned httpThreads = 0;
   bool loadArgAsJson = false;
   bool loadArgAsBson = false;
   std::vector<std::string> filepaths;
   std::map<std::string, std::pair<int64_t, int64_t>> averageTimings;
+  std::mutex averageTimingsMutex;
+  auto recordTiming = [&](std::string const& key, int64_t timeDiff) {
+    std::lock_guard lock(averageTimingsMutex);
+    auto& [count, avg] = averageTimings.try_emplace(key, 0, 0).first->second;
+    auto total = avg * count;
+    count++;
+    avg = (total + timeDiff) / count;
+    std::cout << "took " << timeDiff << " ns (avg:" << avg << ")" << std::endl;
+  };
   for(int i = 1; i < argc; ++i) {
     if(std::string("--force-reload") == argv[i]) {
       forceReload = true;
       continue;
     }
-    if(std::string("--disable-rle") == argv[i]) {
-      disableRLE = true;
+    if(wisent::serializer::parseLoadOption(argc, argv, i, defaults)) {
+      continue;
+    }
+    if(std::string("--segment-dir") == argv[i]) {
+      setSegmentDirectory(argv[++i]);
+      continue;
+    }
+    if(std::string("--transparent-huge-pages") == argv[i]) {
+      SegmentMapping mapping = segmentMapping();
+      mapping.transparentHugePages = true;
+      setSegmentMapping(mapping);
       continue;
     }
-    if(std::string("--disable-csv-handling") == argv[i]) {
-      disableCsvHandling = true;
+    if(std::string("--arena") == argv[i]) {
+      arenaName = argv[++i];
+      continue;
+    }
+    if(std::string("--control-socket") == argv[i]) {
+      controlSocketPath = argv[++i];
+      continue;
+    }
+    if(std::string("--load-threads") == argv[i]) {
+      loadThreads = atoi(argv[++i]);
+      continue;
+    }
+    if(std::string("--http-threads") == argv[i]) {
+      httpThreads = atoi(argv[++i]);
       continue;
     }
     if(std::string("--http-port") == argv[i]) {
@@ -43,9 +91,132 @@ int main(int argc, char** argv) {
     }
     filepaths.emplace_back(argv[i]);
   }
-  std::vector<std::string> names;
-  names.reserve(filepaths.size());
-  for(auto const& filepath : filepaths) {
+  // the catalog segment listing the datasets (and publishing their states) to the readers
+  freeMemorySegment(WISENT_CATALOG_SEGMENT); // (the catalog of a previous run)
+  auto& catalogSegment = createOrGetMemorySegment(WISENT_CATALOG_SEGMENT);
+  auto* catalog = static_cast<WisentCatalog*>(catalogSegment.malloc(sizeof(WisentCatalog)));
+  catalog->magic = WISENT_CATALOG_MAGIC;
+  catalogSegment.persist();
+  std::mutex catalogMutex;
+  auto publishState = [&](std::string const& name, uint32_t state,
+                          WisentDatasetDescription const* description = nullptr) {
+    std::lock_guard lock(catalogMutex);
+    if(state == WISENT_DATASET_UNKNOWN && findCatalogEntry(catalog, name.c_str()) == nullptr) {
+      return; // (erasing a dataset never published)
+    }
+    if(!publishCatalogEntry(catalog, name.c_str(), state, description)) {
+      std::cout << "cannot publish the state of '" << name << "' (no entry left)" << std::endl;
+    }
+  };
+  // with --arena, the Wisent datasets are entries of a single segment
+  std::unique_ptr<SegmentArena> arena;
+  if(!arenaName.empty()) {
+    arena = std::make_unique<SegmentArena>(arenaName, segmentDirectory());
+  }
+  /* where a loaded dataset is (its own segment, or its tree in the arena) and what it holds
+   * (its current generation, read under its lock: a concurrent reload cannot replace it and
+   * unmap it meanwhile) */
+  auto describeDataset = [&](std::string const& name, uint32_t kind) {
+    WisentDatasetDescription description{};
+    description.kind = kind;
+    auto inArena = arena && kind == WISENT_DATASET_KIND_WISENT;
+    auto const& segmentName = inArena ? arenaName : name;
+    segmentName.copy(description.segmentName, WISENT_DATASET_NAME_SIZE - 1);
+    auto lock = lockMemorySegment(name);
+    void* data = nullptr;
+    if(inArena) {
+      data = arena->find(name);
+      description.offset = data != nullptr ? static_cast<char*>(data) - arena->baseAddress() : 0;
+      description.size = arena->allocationSize(name);
+    } else {
+      auto& segment = createOrGetMemorySegment(name);
+      data = segment.loaded() ? segment.baseAddress() : nullptr;
+      description.size = data != nullptr ? segment.size() : 0;
+    }
+    if(data == nullptr) {
+      throw std::runtime_error("no dataset loaded: " + name); // (erased meanwhile)
+    }
+    if(kind == WISENT_DATASET_KIND_WISENT) {
+      describeExpressionTree(static_cast<WisentRootExpression*>(data), &description);
+    }
+    description.loadedAt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::system_clock::now().time_since_epoch())
+                               .count();
+    return description;
+  };
+  auto isLoaded = [&](std::string const& name) {
+    WisentCatalogEntry entry{};
+    return readCatalogEntry(catalog, name.c_str(), &entry) &&
+           entry.state == WISENT_DATASET_READY;
+  };
+  // the time spent in each phase by the last load of each dataset (for /stats)
+  struct LoadProfile {
+    uint64_t parsingNanoseconds = 0;
+    uint64_t serializingNanoseconds = 0;
+    uint64_t totalNanoseconds = 0;
+  };
+  std::map<std::string, LoadProfile> loadProfiles;
+  std::mutex loadProfilesMutex;
+  /* serialize a dataset (publishing its state and its description in the catalog), reporting
+   * the progress of Wisent loads; a dataset already loaded is only mapped again (unless
+   * reloaded), keeping its generation */
+  auto loadDataset = [&](std::string const& name, std::string const& filepath, bool loadCSV,
+                         bool serializeToBson, bool serializeToJson, bool reload,
+                         wisent::serializer::ColumnProjection const& projection,
+                         wisent::serializer::LoadProgress* progress) {
+    auto filenamePos = filepath.find_last_of("/\\");
+    auto csvPrefix = filepath.substr(0, filenamePos + 1);
+    auto alreadyLoaded = !reload && isLoaded(name);
+    if(!alreadyLoaded) {
+      publishState(name, WISENT_DATASET_LOADING);
+    }
+    wisent::serializer::LoadProgress loadProgress; // (timing the phases if not reported)
+    if(progress == nullptr) {
+      progress = &loadProgress;
+    }
+    auto start = std::chrono::steady_clock::now();
+    WisentDatasetDescription description{};
+    try {
+      if(serializeToBson) {
+        bson::serializer::loadAsBson(filepath, name, csvPrefix,
+                                     defaults.disableCsvHandling || !loadCSV, reload);
+        description = describeDataset(name, WISENT_DATASET_KIND_BSON);
+      } else if(serializeToJson) {
+        bson::serializer::loadAsJson(filepath, name, csvPrefix,
+                                     defaults.disableCsvHandling || !loadCSV, reload);
+        description = describeDataset(name, WISENT_DATASET_KIND_JSON);
+      } else {
+        auto options = defaults;
+        options.disableCsvHandling = defaults.disableCsvHandling || !loadCSV;
+        options.forceReload = reload;
+        options.columns = projection;
+        options.progress = progress;
+        if(arena) {
+          wisent::serializer::load(filepath, *arena, name, csvPrefix, options);
+        } else {
+          wisent::serializer::load(filepath, name, csvPrefix, options);
+        }
+        description = describeDataset(name, WISENT_DATASET_KIND_WISENT);
+      }
+    } catch(...) {
+      publishState(name, WISENT_DATASET_FAILED);
+      throw;
+    }
+    if(alreadyLoaded) {
+      return;
+    }
+    description.loadNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count();
+    {
+      std::lock_guard lock(loadProfilesMutex);
+      loadProfiles[name] = {progress->parsingNanoseconds, progress->serializingNanoseconds,
+                            description.loadNanoseconds};
+    }
+    publishState(name, WISENT_DATASET_READY, &description);
+  };
+  std::vector<std::string> names(filepaths.size());
+  auto loadFilepath = [&](std::string const& filepath, std::string& loadedName) {
     auto filenamePos = filepath.find_last_of("/\\");
     auto filename = filepath.substr(filenamePos + 1);
     auto extPos = filename.find_last_of(".");
@@ -64,92 +235,533 @@ int main(int argc, char** argv) {
           assert(!column.is_null());
         }
         auto end = std::chrono::high_resolution_clock::now();
-        auto timeDiff = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-        auto& [count, avg] = averageTimings.try_emplace(filepath, 0, 0).first->second;
-        auto total = avg * count;
-        count++;
-        avg = (total + timeDiff) / count;
-        std::cout << "took " << timeDiff << " ns (avg:" << avg << ")" << std::endl;
-        continue;
+        recordTiming(filepath,
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        return;
       }
       std::cout << "unsupported, not a json file: " << filepath;
-      continue;
+      return;
     }
     auto filenameWithoutExt = filename.substr(0, extPos);
-    auto csvPrefix = filepath.substr(0, filenamePos + 1);
-    if(loadArgAsBson) {
-      bson::serializer::loadAsBson(filepath, filenameWithoutExt, csvPrefix);
-    } else if(loadArgAsJson) {
-      void* ptr = bson::serializer::loadAsJson(filepath, filenameWithoutExt, csvPrefix);
-    } else {
-      auto root = wisent::serializer::load(filepath, filenameWithoutExt, csvPrefix, disableRLE,
-                                           disableCsvHandling, forceReload);
+    loadDataset(filenameWithoutExt, filepath, true, loadArgAsBson, loadArgAsJson, forceReload,
+                defaults.columns, nullptr);
+    loadedName = filenameWithoutExt;
+  };
+  // load the datasets of the command line in parallel (the segments are independent)
+  {
+    if(loadThreads == 0) {
+      loadThreads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto worker = [&]() {
+      for(auto i = next++; i < filepaths.size(); i = next++) {
+        try {
+          loadFilepath(filepaths[i], names[i]);
+        } catch(...) {
+          std::lock_guard lock(errorMutex);
+          if(!error) {
+            error = std::current_exception();
+          }
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < std::min<size_t>(loadThreads, filepaths.size()); ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& thread : threads) {
+      thread.join();
     }
-    names.emplace_back(filenameWithoutExt);
+    if(error) {
+      std::rethrow_exception(error);
+    }
+    names.erase(std::remove(names.begin(), names.end(), std::string()), names.end());
   }
 
   httplib::Server svr;
+  if(httpThreads > 0) {
+    svr.new_task_queue = [httpThreads] { return new httplib::ThreadPool(httpThreads); };
+  }
+  // asynchronous loads (/load?async=1): the request returns the job's id right away
+  struct LoadJob {
+    std::string name;
+    wisent::serializer::LoadProgress progress;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end; // (guarded by jobsMutex)
+    std::string error;                         // (guarded by jobsMutex)
+    bool reported = false; // its end was reported by /jobs (guarded by jobsMutex)
+  };
+  std::mutex jobsMutex;
+  std::map<uint64_t, std::unique_ptr<LoadJob>> jobs;
+  std::vector<std::thread> jobThreads;
+  std::vector<std::thread::id> finishedJobThreads; // (ran their job, not joined yet)
+  uint64_t nextJobId = 1;
+  // on each asynchronous load (holding jobsMutex): join the threads of the finished jobs and
+  // forget the jobs whose end was reported
+  auto pruneJobs = [&jobs, &jobThreads, &finishedJobThreads]() {
+    for(auto id : finishedJobThreads) {
+      auto thread = std::find_if(jobThreads.begin(), jobThreads.end(),
+                                 [id](auto const& candidate) { return candidate.get_id() == id; });
+      thread->join(); // (returning: it no longer takes the mutex)
+      jobThreads.erase(thread);
+    }
+    finishedJobThreads.clear();
+    for(auto it = jobs.begin(); it != jobs.end();) {
+      it = it->second->reported ? jobs.erase(it) : std::next(it);
+    }
+  };
   svr.Get("/load", [&](const httplib::Request& req, httplib::Response& res) {
     auto const& name = req.get_param_value("name");
     auto const& filepath = req.get_param_value("path");
-    bool loadCSV = true;
-    if(req.has_param("loadCSV")) {
-      auto const& str = req.get_param_value("loadCSV");
-      loadCSV = (str.empty() || str == "True" || str == "true" || atoi(str.c_str()) > 0);
-    }
-    bool serializeToBson = false;
-    if(req.has_param("toBson")) {
-      auto const& str = req.get_param_value("toBson");
-      serializeToBson = (str.empty() || str == "True" || str == "true" || atoi(str.c_str()) > 0);
+    auto isSet = [&req](char const* param, bool defaultValue) {
+      if(!req.has_param(param)) {
+        return defaultValue;
+      }
+      auto const& str = req.get_param_value(param);
+      return str.empty() || str == "True" || str == "true" || atoi(str.c_str()) > 0;
+    };
+    bool loadCSV = isSet("loadCSV", true);
+    bool serializeToBson = isSet("toBson", false);
+    bool serializeToJson = isSet("toJson", false);
+    bool reload = isSet("reload", false); // (a new generation, replacing the current one)
+    auto projection = defaults.columns;
+    if(req.has_param("columns")) {
+      projection.patterns = wisent::serializer::splitPatterns(req.get_param_value("columns"));
     }
-    bool serializeToJson = false;
-    if(req.has_param("toJson")) {
-      auto const& str = req.get_param_value("toJson");
-      serializeToJson = (str.empty() || str == "True" || str == "true" || atoi(str.c_str()) > 0);
+    projection.placeholders = isSet("placeholders", defaults.columns.placeholders);
+    if(isSet("async", false)) {
+      std::lock_guard lock(jobsMutex);
+      pruneJobs();
+      auto jobId = nextJobId++;
+      auto* job = jobs.emplace(jobId, std::make_unique<LoadJob>()).first->second.get();
+      job->name = name;
+      job->start = std::chrono::steady_clock::now();
+      if(reload || !isLoaded(name)) {
+        publishState(name, WISENT_DATASET_LOADING); // (before the readers get the job's id)
+      }
+      std::cout << "loading dataset '" << name << "' from '" << filepath << "' (job " << jobId
+                << ")" << std::endl;
+      jobThreads.emplace_back([&, job, name, filepath, loadCSV, serializeToBson, serializeToJson,
+                               reload, projection]() {
+        std::string error;
+        try {
+          loadDataset(name, filepath, loadCSV, serializeToBson, serializeToJson, reload,
+                      projection, &job->progress);
+        } catch(std::exception const& e) {
+          error = e.what();
+          std::cout << "failed to load '" << name << "': " << error << std::endl;
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto timeDiff = std::chrono::duration_cast<std::chrono::nanoseconds>(end - job->start);
+        recordTiming(name + filepath, timeDiff.count());
+        std::lock_guard lock(jobsMutex);
+        job->end = end;
+        job->error = error;
+        job->progress.phase = error.empty() ? wisent::serializer::LoadProgress::Phase::finished
+                                            : wisent::serializer::LoadProgress::Phase::failed;
+        finishedJobThreads.push_back(std::this_thread::get_id());
+      });
+      res.set_content(std::to_string(jobId), "text/plain");
+      return;
     }
     std::cout << "loading dataset '" << name << "' from '" << filepath << "'" << std::endl;
     auto start = std::chrono::high_resolution_clock::now();
-    auto filenamePos = filepath.find_last_of("/\\");
-    auto csvPrefix = filepath.substr(0, filenamePos + 1);
-    if(serializeToBson) {
-      bson::serializer::loadAsBson(filepath, name, csvPrefix, disableCsvHandling || !loadCSV);
-    } else if(serializeToJson) {
-      void* ptr =
-          bson::serializer::loadAsJson(filepath, name, csvPrefix, disableCsvHandling || !loadCSV);
+    loadDataset(name, filepath, loadCSV, serializeToBson, serializeToJson, reload, projection,
+                nullptr);
+    auto end = std::chrono::high_resolution_clock::now();
+    recordTiming(name + filepath,
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    res.set_content("Done.", "text/plain");
+  });
+  svr.Get(R"(/jobs/(\d+))", [&](const httplib::Request& req, httplib::Response& res) {
+    using Phase = wisent::serializer::LoadProgress::Phase;
+    auto jobId = std::stoull(req.matches[1].str());
+    std::lock_guard lock(jobsMutex);
+    auto it = jobs.find(jobId);
+    if(it == jobs.end()) {
+      res.status = 404;
+      res.set_content("no job " + std::to_string(jobId), "text/plain");
+      return;
+    }
+    auto& job = *it->second;
+    auto phase = job.progress.phase.load();
+    uint64_t bytesProcessed = job.progress.bytesProcessed;
+    uint64_t bytesTotal = job.progress.bytesTotal;
+    bool done = phase == Phase::finished || phase == Phase::failed;
+    if(done) {
+      job.reported = true; // (forgotten on the next asynchronous load)
+    }
+    auto elapsed = std::chrono::duration<double>(
+                       (done ? job.end : std::chrono::steady_clock::now()) - job.start)
+                       .count();
+    static char const* const phaseNames[] = {"queued", "parsing", "serializing", "finished",
+                                             "failed"};
+    json report = {{"id", jobId},
+                   {"name", job.name},
+                   {"phase", phaseNames[static_cast<int>(phase)]},
+                   {"bytesProcessed", bytesProcessed},
+                   {"bytesTotal", bytesTotal},
+                   {"elapsedSeconds", elapsed}};
+    if(!done && bytesProcessed > 0 && bytesTotal >= bytesProcessed) {
+      // (an estimate: the total grows as the csv files are found)
+      report["etaSeconds"] = elapsed * static_cast<double>(bytesTotal - bytesProcessed) /
+                             static_cast<double>(bytesProcessed);
+    }
+    if(!job.error.empty()) {
+      report["error"] = job.error;
+    }
+    res.set_content(report.dump(), "application/json");
+  });
+  /* the composition of a loaded Wisent dataset (cached per generation), mapping its segment */
+  std::map<std::string, std::pair<uint32_t, wisent::serializer::TreeComposition>> compositions;
+  std::mutex compositionsMutex;
+  auto getComposition = [&](WisentCatalogEntry const& entry) {
+    {
+      std::lock_guard lock(compositionsMutex);
+      auto it = compositions.find(entry.name);
+      if(it != compositions.end() && it->second.first == entry.generation) {
+        return std::optional(it->second.second);
+      }
+    }
+    // (computed without holding the cache: a large tree takes a while)
+    auto const& description = entry.description;
+    wisent::serializer::TreeComposition composition;
+    if(arena && arenaName == description.segmentName) {
+      // (under the dataset's lock: neither a reload nor an erase releases the tree meanwhile)
+      auto datasetLock = lockMemorySegment(entry.name);
+      auto* root = arena->find(entry.name);
+      if(root == nullptr || root != arena->baseAddress() + description.offset) {
+        return std::optional<wisent::serializer::TreeComposition>(); // (replaced since)
+      }
+      composition = wisent::serializer::getComposition(static_cast<WisentRootExpression*>(root));
     } else {
-      auto root = wisent::serializer::load(filepath, name, csvPrefix, disableRLE,
-                                           disableCsvHandling || !loadCSV);
+      auto descriptor = openMemorySegmentDescriptor(description.segmentName);
+      if(descriptor < 0) {
+        return std::optional<wisent::serializer::TreeComposition>();
+      }
+      auto size = description.offset + description.size;
+      // (touching the pages past the end of a file smaller than described raises SIGBUS)
+      struct stat status {};
+      if(fstat(descriptor, &status) != 0 || static_cast<uint64_t>(status.st_size) < size) {
+        close(descriptor);
+        return std::optional<wisent::serializer::TreeComposition>();
+      }
+      auto* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+      close(descriptor);
+      if(address == MAP_FAILED) {
+        return std::optional<wisent::serializer::TreeComposition>();
+      }
+      composition = wisent::serializer::getComposition(reinterpret_cast<WisentRootExpression*>(
+          static_cast<char*>(address) + description.offset));
+      munmap(address, size);
+    }
+    std::lock_guard lock(compositionsMutex);
+    compositions[entry.name] = {entry.generation, composition};
+    return std::optional(composition);
+  };
+  auto getDatasetStats = [&](WisentCatalogEntry const& entry, size_t attachedProcesses) {
+    static char const* const stateNames[] = {"unknown", "loading", "ready", "failed"};
+    static char const* const kindNames[] = {"unknown", "wisent", "json", "bson"};
+    auto const& description = entry.description;
+    json stats = {{"name", entry.name},
+                  {"state", stateNames[std::min(entry.state, uint32_t{WISENT_DATASET_FAILED})]},
+                  {"generation", entry.generation}};
+    if(entry.state != WISENT_DATASET_READY) {
+      return stats;
+    }
+    LoadProfile profile;
+    {
+      std::lock_guard lock(loadProfilesMutex);
+      auto it = loadProfiles.find(entry.name);
+      profile = it != loadProfiles.end() ? it->second : LoadProfile{};
+    }
+    stats["kind"] = kindNames[std::min(description.kind, uint32_t{WISENT_DATASET_KIND_BSON})];
+    stats["segment"] = description.segmentName;
+    stats["sizeBytes"] = description.size;
+    stats["attachedProcesses"] = attachedProcesses;
+    stats["loadSeconds"] = {{"parsing", profile.parsingNanoseconds / 1e9},
+                            {"serializing", profile.serializingNanoseconds / 1e9},
+                            {"total", profile.totalNanoseconds / 1e9}};
+    if(description.kind != WISENT_DATASET_KIND_WISENT) {
+      return stats;
+    }
+    stats["expressions"] = description.expressionCount;
+    stats["arguments"] = description.argumentCount;
+    stats["tables"] = description.tableCount;
+    stats["csvColumns"] = description.columnCount;
+    stats["csvRows"] = description.rowCount;
+    if(auto composition = getComposition(entry)) {
+      auto usedBytes = composition->totalBytes();
+      stats["buffers"] = {{"header", composition->headerBytes},
+                          {"arguments", composition->argumentBytes},
+                          {"types", composition->typeBytes},
+                          {"nullBitmap", composition->nullBitmapBytes},
+                          {"structure", composition->structureBytes},
+                          {"strings", composition->stringBytes},
+                          {"sections", composition->sectionBytes},
+                          {"unused", description.size > usedBytes
+                                         ? description.size - usedBytes
+                                         : uint64_t{0}}};
+      stats["rleRuns"] = composition->rleRuns;
+      stats["rleArguments"] = composition->rleArguments;
+      // the arguments per type a reader decodes (1: no run)
+      stats["rleRatio"] = composition->typeRuns > 0
+                              ? static_cast<double>(description.argumentCount) /
+                                    static_cast<double>(composition->typeRuns)
+                              : 1.0;
+    }
+    return stats;
+  };
+  /* the stats as Prometheus metrics: wisent_dataset_<field>{dataset="..."} */
+  auto toPrometheus = [](json const& datasets, json const& timings) {
+    static std::map<std::string, std::pair<std::string, std::string>> const breakdowns = {
+        {"buffers", {"buffer_bytes", "buffer"}}, {"loadSeconds", {"load_seconds", "phase"}}};
+    auto escape = [](std::string const& value) {
+      std::string escaped;
+      for(auto c : value) {
+        if(c == '\n') {
+          escaped += "\\n";
+          continue;
+        }
+        if(c == '"' || c == '\\') {
+          escaped += '\\';
+        }
+        escaped += c;
+      }
+      return escaped;
+    };
+    auto snakeCase = [](std::string const& name) {
+      std::string snake;
+      for(auto c : name) {
+        snake += std::isupper(c) ? "_" + std::string(1, static_cast<char>(std::tolower(c)))
+                                 : std::string(1, c);
+      }
+      return snake;
+    };
+    std::map<std::string, std::string> metrics; // (the samples of each metric)
+    for(auto const& stats : datasets) {
+      auto labels = "dataset=\"" + escape(stats["name"].get<std::string>()) + "\"";
+      for(auto const& [key, value] : stats.items()) {
+        if(value.is_number()) {
+          metrics["wisent_dataset_" + snakeCase(key)] += "{" + labels + "} " + value.dump() + "\n";
+        } else if(value.is_object() && breakdowns.count(key) > 0) {
+          auto const& [metric, label] = breakdowns.at(key);
+          for(auto const& [part, partValue] : value.items()) {
+            metrics["wisent_dataset_" + metric] += "{" + labels + "," + label + "=\"" + part +
+                                                   "\"} " + partValue.dump() + "\n";
+          }
+        }
+      }
+    }
+    for(auto const& timing : timings) {
+      auto labels = "{key=\"" + escape(timing["key"].get<std::string>()) + "\"} ";
+      metrics["wisent_load_count"] += labels + timing["count"].dump() + "\n";
+      metrics["wisent_load_average_seconds"] += labels + timing["averageSeconds"].dump() + "\n";
+    }
+    std::string text;
+    for(auto const& [metric, samples] : metrics) {
+      text += "# TYPE " + metric + " gauge\n";
+      for(size_t start = 0; start < samples.size();) {
+        auto end = samples.find('\n', start) + 1;
+        text += metric + samples.substr(start, end - start);
+        start = end;
+      }
+    }
+    return text;
+  };
+  svr.Get("/stats", [&](const httplib::Request& req, httplib::Response& res) {
+    std::vector<WisentCatalogEntry> entries;
+    std::vector<std::string> segmentNames;
+    auto count = __atomic_load_n(&catalog->count, __ATOMIC_ACQUIRE);
+    for(uint32_t i = 0; i < count; ++i) {
+      WisentCatalogEntry entry{};
+      if(readCatalogEntry(catalog, catalog->datasets[i].name, &entry) &&
+         entry.state != WISENT_DATASET_UNKNOWN) {
+        entries.push_back(entry);
+        segmentNames.push_back(entry.description.segmentName);
+      }
+    }
+    // (a single pass over /proc for all the segments)
+    auto attachedProcesses = countMemorySegmentMappings(segmentNames);
+    json datasets = json::array();
+    for(auto const& entry : entries) {
+      datasets.push_back(getDatasetStats(entry, attachedProcesses[entry.description.segmentName]));
+    }
+    json timings = json::array();
+    {
+      std::lock_guard lock(averageTimingsMutex);
+      for(auto const& [key, timing] : averageTimings) {
+        timings.push_back(
+            {{"key", key}, {"count", timing.first}, {"averageSeconds", timing.second / 1e9}});
+      }
+    }
+    if(req.get_param_value("format") == "prometheus") {
+      res.set_content(toPrometheus(datasets, timings), "text/plain; version=0.0.4");
+      return;
+    }
+    res.set_content(json({{"datasets", datasets}, {"timings", timings}}).dump(),
+                    "application/json");
+  });
+  svr.Get("/append", [&](const httplib::Request& req, httplib::Response& res) {
+    auto const& name = req.get_param_value("name");
+    auto const& filepath = req.get_param_value("path");
+    auto tablePath = req.has_param("table") ? req.get_param_value("table")
+                                            : std::string("resources[0].Object.path.Table");
+    std::cout << "appending '" << filepath << "' to '" << tablePath << "' of dataset '" << name
+              << "'" << std::endl;
+    wisent::serializer::LoadOptions options;
+    options.disableRLE = defaults.disableRLE;
+    options.csvParser = defaults.csvParser;
+    options.csvThreads = defaults.csvThreads;
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+      if(arena) {
+        wisent::serializer::append(*arena, name, tablePath, filepath, options);
+      } else {
+        wisent::serializer::append(name, tablePath, filepath, options);
+      }
+      auto description = describeDataset(name, WISENT_DATASET_KIND_WISENT);
+      description.loadNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::high_resolution_clock::now() - start)
+                                        .count();
+      publishState(name, WISENT_DATASET_READY, &description); // (a new generation)
+    } catch(std::exception const& e) {
+      std::cout << "failed: " << e.what() << std::endl;
+      res.status = 400;
+      res.set_content(e.what(), "text/plain");
+      return;
     }
     auto end = std::chrono::high_resolution_clock::now();
     auto timeDiff = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-    auto& [count, avg] = averageTimings.try_emplace(name + filepath, 0, 0).first->second;
-    auto total = avg * count;
-    count++;
-    avg = (total + timeDiff) / count;
-    std::cout << "took " << timeDiff << " ns (avg:" << avg << ")" << std::endl;
+    std::cout << "took " << timeDiff << " ns" << std::endl;
     res.set_content("Done.", "text/plain");
   });
-  svr.Get("/unload", [&](const httplib::Request& req, httplib::Response& res) {
-    auto const& name = req.get_param_value("name");
+  auto unloadDataset = [&](std::string const& name) {
     std::cout << "unloading dataset '" << name << "'" << std::endl;
-    wisent::serializer::unload(name);
+    if(!arena || arena->find(name) == nullptr) { // (the arena stays mapped)
+      wisent::serializer::unload(name);
+    }
+  };
+  auto eraseDataset = [&](std::string const& name) {
+    std::cout << "erasing dataset '" << name << "'" << std::endl;
+    if(arena && arena->find(name) != nullptr) {
+      wisent::serializer::free(*arena, name);
+    } else {
+      wisent::serializer::free(name);
+    }
+    publishState(name, WISENT_DATASET_UNKNOWN);
+  };
+  svr.Get("/unload", [&](const httplib::Request& req, httplib::Response& res) {
+    unloadDataset(req.get_param_value("name"));
     res.set_content("Done.", "text/plain");
   });
   svr.Get("/erase", [&](const httplib::Request& req, httplib::Response& res) {
-    auto const& name = req.get_param_value("name");
-    std::cout << "erasing dataset '" << name << "'" << std::endl;
-    wisent::serializer::free(name);
+    eraseDataset(req.get_param_value("name"));
     res.set_content("Done.", "text/plain");
   });
   svr.Get("/stop",
           [&](const httplib::Request& /*req*/, httplib::Response& /*res*/) { svr.stop(); });
+  // with --control-socket, the same commands in batches on a Unix domain socket (without HTTP)
+  std::unique_ptr<wisent::control::ControlServer> controlServer;
+  std::thread controlThread;
+  if(!controlSocketPath.empty()) {
+    /* a read-only descriptor of a loaded dataset's segment, for the client to map (under its
+     * lock: a concurrent reload cannot replace the segment between the entry and the open) */
+    auto attachDataset = [&](std::string const& name) {
+      auto lock = lockMemorySegment(name);
+      WisentCatalogEntry entry{};
+      if(!readCatalogEntry(catalog, name.c_str(), &entry) ||
+         entry.state != WISENT_DATASET_READY) {
+        throw std::runtime_error("no dataset loaded: " + name);
+      }
+      wisent::control::Reply reply;
+      reply.descriptor = openMemorySegmentDescriptor(entry.description.segmentName);
+      if(reply.descriptor < 0) {
+        throw std::runtime_error("cannot open the segment of: " + name);
+      }
+      reply.offset = entry.description.offset;
+      reply.size = entry.description.size;
+      return reply;
+    };
+    auto handleCommand = [&](wisent::control::Command const& command) {
+      auto const& name = command.name;
+      switch(command.command) {
+      case WISENT_CONTROL_LOAD: {
+        std::cout << "loading dataset '" << name << "' from '" << command.path << "'"
+                  << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        loadDataset(name, command.path, (command.flags & WISENT_CONTROL_SKIP_CSV) == 0,
+                    (command.flags & WISENT_CONTROL_TO_BSON) != 0,
+                    (command.flags & WISENT_CONTROL_TO_JSON) != 0,
+                    (command.flags & WISENT_CONTROL_RELOAD) != 0, defaults.columns,
+                    nullptr);
+        auto end = std::chrono::high_resolution_clock::now();
+        recordTiming(name + command.path,
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        break;
+      }
+      case WISENT_CONTROL_ATTACH:
+        return attachDataset(name);
+      case WISENT_CONTROL_UNLOAD:
+        unloadDataset(name);
+        return wisent::control::Reply{};
+      case WISENT_CONTROL_ERASE:
+        eraseDataset(name);
+        return wisent::control::Reply{};
+      case WISENT_CONTROL_STOP:
+        svr.stop();
+        return wisent::control::Reply{};
+      default:
+        throw std::runtime_error("unknown command: " + std::to_string(command.command));
+      }
+      if((command.flags & WISENT_CONTROL_PASS_DESCRIPTOR) != 0) {
+        return attachDataset(name);
+      }
+      return wisent::control::Reply{};
+    };
+    controlServer =
+        std::make_unique<wisent::control::ControlServer>(controlSocketPath, handleCommand);
+    controlThread = std::thread([&controlServer]() { controlServer->listen(); });
+    std::cout << "Control socket listening on " << controlSocketPath << "..." << std::endl;
+  }
   std::cout << "Server running on port " << httpPort << "..." << std::endl;
   svr.listen("0.0.0.0", httpPort);
+  if(controlServer) {
+    controlServer->stop();
+    controlThread.join();
+    controlServer.reset(); // (after the commands being run)
+  }
+  std::vector<std::thread> runningJobs;
+  {
+    std::lock_guard lock(jobsMutex);
+    std::swap(runningJobs, jobThreads);
+  }
+  for(auto& thread : runningJobs) {
+    thread.join();
+  }
   for(auto const& name : names) {
     // deleting only the datasets loaded with the command line
     // clients manually handle the lifetime of the datasets they request
+    if(!segmentDirectory().empty()) {
+      continue; // kept in their files for a warm restart
+    }
     std::cout << "Deleting " << name << "..." << std::endl;
-    wisent::serializer::free(name);
+    try {
+      if(arena && arena->find(name) != nullptr) {
+        wisent::serializer::free(*arena, name);
+      } else {
+        wisent::serializer::free(name);
+      }
+    } catch(std::exception const& e) {
+      std::cout << "kept '" << name << "': " << e.what() << std::endl; // (still read)
+    }
+  }
+  if(arena && segmentDirectory().empty() && arena->header()->entryCount == 0) {
+    arena->erase();
   }
+  freeMemorySegment(WISENT_CATALOG_SEGMENT);
   return 0;
 }
\ No newline at end of file